@@ -0,0 +1,138 @@
+/* Benchmark of BST insert/contains: the iterative paths used by BST
+   against the recursive Node::insert/Node::search they replace, and the
+   binary trees against the wide-node BTree.
+
+   g++ -std=c++20 -O2 -pthread bench/bst_bench.cpp -o bst_bench && ./bst_bench
+*/
+#define BST_NO_MAIN
+#include "../bst4.cpp"
+#include<chrono>
+#include<random>
+#include<vector>
+
+template<class F>
+double ns_per_op(size_t ops, F&& f) {   // runs f once, returns ns per op
+  auto start = chrono::steady_clock::now();
+  f();
+  auto stop = chrono::steady_clock::now();
+  return chrono::duration<double,nano>(stop-start).count() / ops;
+}
+
+volatile size_t sink;  // keeps results alive
+
+template<class T>
+void bench(const char* name, vector<T>& keys) {
+  size_t n = keys.size();
+  using rnode = Node<T,standard_cmp<T>>;
+  heap_nodes pool;
+  standard_cmp<T> cmp;
+  option_ptr<rnode> root;
+  size_t found = 0;
+
+  double rec_insert = ns_per_op(n, [&]() {
+    root = Some<rnode>(keys[0]);
+    for(size_t i=1;i<n;i++)
+      root.map_do([&](rnode& r) { r.insert(keys[i],pool,cmp); });
+  });
+  double rec_search = ns_per_op(n, [&]() {
+    for(size_t i=0;i<n;i++)
+      found += root.tmatch([&](rnode& r) { return r.search(keys[i],cmp); },
+                           []() { return false; });
+  });
+
+  BST<T> tree;
+  double it_insert = ns_per_op(n, [&]() {
+    for(T& k : keys) tree.insert(k);
+  });
+  double it_search = ns_per_op(n, [&]() {
+    for(T& k : keys) found += tree.contains(k);
+  });
+  sink = found;
+
+  cout << name << " (" << n << " keys)\n"
+       << "  insert:   recursive " << rec_insert << " ns, iterative "
+       << it_insert << " ns\n"
+       << "  contains: recursive " << rec_search << " ns, iterative "
+       << it_search << " ns\n";
+}//bench
+
+// insert and lookup cost of one ordered container over the same keys
+template<class Tree, class T>
+void bench_container(const char* name, vector<T>& keys) {
+  Tree tree;
+  size_t found = 0;
+  double insert = ns_per_op(keys.size(), [&]() {
+    for(T& k : keys) tree.insert(k);
+  });
+  double search = ns_per_op(keys.size(), [&]() {
+    for(T& k : keys) found += tree.contains(k);
+  });
+  sink = found;
+  cout << "  " << name << ": insert " << insert << " ns, contains "
+       << search << " ns\n";
+}//bench_container
+
+int main() {
+  mt19937 gen(42);
+  vector<int> random_keys(1000000);
+  for(int& k : random_keys) k = gen();
+  bench("random", random_keys);
+
+  // sorted input makes the plain BST a list, so keep it small enough for
+  // the recursive path not to overflow the stack
+  vector<int> sorted_keys(10000);
+  for(int i=0;i<10000;i++) sorted_keys[i] = i;
+  bench("sorted", sorted_keys);
+
+  // long string keys: the recursive path copies the key at every level
+  vector<string> string_keys(200000);
+  for(string& k : string_keys) k = to_string(gen()) + string(32,'x');
+  bench("random strings", string_keys);
+
+  vector<int64_t> wide_keys(1000000);
+  for(int64_t& k : wide_keys) k = ((int64_t)gen() << 32) | gen();
+  cout << "ordered containers (1000000 random int64 keys)\n";
+  bench_container<BST<int64_t>>("BST", wide_keys);
+  bench_container<BalancedBST<int64_t>>("BalancedBST", wide_keys);
+  bench_container<BTree<int64_t>>("BTree<16>", wide_keys);
+  bench_container<BTree<int64_t,standard_cmp<int64_t>,32>>("BTree<32>", wide_keys);
+
+  // batched lookups against one contains call per key
+  BST<int64_t> tree = BST<int64_t>::from_range(wide_keys);
+  vector<int64_t> queries(1000000);
+  for(int64_t& q : queries) q = wide_keys[gen() % wide_keys.size()];
+  option_ptr<bool[]> out = Some_array<bool>(queries.size());
+  size_t found = 0;
+  double single = ns_per_op(queries.size(), [&]() {
+    for(int64_t& q : queries) found += tree.contains(q);
+  });
+  double batched = ns_per_op(queries.size(), [&]() {
+    tree.contains_many(queries, span<bool>(&out[0],out.size()));
+  });
+  int64_t total = 0;
+  double inorder = ns_per_op(tree.size(), [&]() {
+    tree.map_inorder([&](int64_t& x) { total += x; });
+  });
+  double reduce = ns_per_op(tree.size(), [&]() {
+    total += tree.parallel_reduce([](int64_t a, int64_t b) { return a+b; }, 0);
+  });
+  sink = total;
+  cout << "traversal (" << thread::hardware_concurrency() << " threads)\n"
+       << "  map_inorder " << inorder << " ns, parallel_reduce " << reduce
+       << " ns per item\n";
+
+  FrozenBST<int64_t> frozen = tree.freeze();
+  double frozen_single = ns_per_op(queries.size(), [&]() {
+    for(int64_t& q : queries) found += frozen.contains(q);
+  });
+  double frozen_batched = ns_per_op(queries.size(), [&]() {
+    frozen.contains_many(queries, span<bool>(&out[0],out.size()));
+  });
+  sink = found + out[0];
+  cout << "batched lookups (balanced BST of " << tree.size() << " keys)\n"
+       << "  BST:       contains " << single << " ns, contains_many "
+       << batched << " ns\n"
+       << "  FrozenBST: contains " << frozen_single << " ns, contains_many "
+       << frozen_batched << " ns\n";
+  return 0;
+}//main
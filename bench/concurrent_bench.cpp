@@ -0,0 +1,65 @@
+/* Scaling benchmark of ConcurrentBST lookups from 1 to N threads, against
+   a BST behind one mutex.  N defaults to the number of hardware threads
+   and can be given as the first argument.
+
+   g++ -std=c++20 -O2 -pthread bench/concurrent_bench.cpp -o concurrent_bench
+   ./concurrent_bench [N]
+*/
+#define BST_NO_MAIN
+#include "../bst4.cpp"
+#include<chrono>
+#include<random>
+#include<thread>
+#include<vector>
+
+const size_t Keys = 1000000;         // tree size
+const size_t LookupsPerThread = 1000000;
+
+// runs lookup(thread_id, key) from `threads` threads, returns lookups/s
+template<class F>
+double throughput(unsigned threads, vector<int>& queries, F&& lookup) {
+  atomic<size_t> found{0};
+  vector<thread> workers;
+  auto start = chrono::steady_clock::now();
+  for(unsigned t=0;t<threads;t++)
+    workers.emplace_back([&,t]() {
+      size_t f = 0;
+      for(size_t i=0;i<LookupsPerThread;i++)
+        f += lookup(queries[(i*threads+t) % queries.size()]);
+      found += f;
+    });
+  for(thread& w : workers) w.join();
+  auto stop = chrono::steady_clock::now();
+  double secs = chrono::duration<double>(stop-start).count();
+  return threads*LookupsPerThread / secs;
+}//throughput
+
+int main(int argc, char* argv[]) {
+  unsigned maxthreads = argc>1 ? stoi(argv[1]) : thread::hardware_concurrency();
+  if (maxthreads==0) maxthreads = 1;
+  mt19937 gen(42);
+  vector<int> keys(Keys);
+  for(int& k : keys) k = gen();
+  vector<int> queries(1<<20);
+  for(int& q : queries) q = keys[gen() % Keys];
+
+  ConcurrentBST<int> ctree;
+  BST<int> tree;
+  mutex tree_lock;
+  for(int k : keys) { ctree.insert(k); tree.insert(k); }
+
+  cout << "lookups per second (millions), tree of " << ctree.size()
+       << " keys\nthreads  ConcurrentBST  BST+mutex\n";
+  vector<unsigned> counts;  // 1, 2, 4, ... and maxthreads
+  for(unsigned t=1; t<maxthreads; t*=2) counts.push_back(t);
+  counts.push_back(maxthreads);
+  for(unsigned t : counts) {
+    double c = throughput(t, queries, [&](int k) { return ctree.contains(k); });
+    double m = throughput(t, queries, [&](int k) {
+      lock_guard<mutex> guard(tree_lock);
+      return tree.contains(k);
+    });
+    cout << t << "\t " << c/1e6 << "\t\t" << m/1e6 << endl;
+  }
+  return 0;
+}//main
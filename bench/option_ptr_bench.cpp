@@ -0,0 +1,256 @@
+/* Benchmark of option_ptr against the unique_ptr and std::optional code it
+   replaces: Some/Nothing creation and each combinator, option_ptr<T[]>
+   Map/reduce/find from 1K up to N items against plain loops over a
+   vector, and BST insert/contains/map_inorder against std::set.  N
+   defaults to 10000000 and can be given as the first argument (100000000
+   needs about 1.2GB).
+
+   g++ -std=c++20 -O2 -pthread bench/option_ptr_bench.cpp -o option_ptr_bench
+   ./option_ptr_bench [N]
+
+   (with -O3, g++ also vectorizes Map, whose result it cannot prove does
+   not overlap the source)
+*/
+#include<chrono>
+#include<memory>
+#include<optional>
+#include<random>
+#include<set>
+#include<vector>
+#define BST_NO_MAIN
+#include "../bst4.cpp"
+
+template<class F>
+double ns_per_op(size_t ops, F&& f) {   // runs f once, returns ns per op
+  auto start = chrono::steady_clock::now();
+  f();
+  auto stop = chrono::steady_clock::now();
+  return chrono::duration<double,nano>(stop-start).count() / ops;
+}
+
+// makes the compiler assume x is read and changed here, so work on it can
+// neither be removed nor hoisted out of the timed loop
+template<class T>
+void escape(T& x) { asm volatile("" : : "g"(&x) : "memory"); }
+
+volatile long sink;  // keeps results alive
+
+void row(const char* name, double option, double unique, double optional) {
+  printf("  %-10s option_ptr %6.2f   unique_ptr %6.2f   optional %6.2f\n",
+         name, option, unique, optional);
+}
+
+const size_t Ops = 10000000;
+
+void bench_scalar() {
+  long total = 0;
+  cout << "combinators (ns per op)\n";
+  row("Some",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { auto p = Some<long>(i); escape(p); }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { auto p = make_unique<long>(i); escape(p); }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { optional<long> p(i); escape(p); }
+      }));
+  row("Nothing",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { auto p = Nothing<long>(); escape(p); }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { unique_ptr<long> p; escape(p); }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { optional<long> p; escape(p); }
+      }));
+
+  auto p = Some<long>(1);
+  auto u = make_unique<long>(1);
+  optional<long> o = 1;
+  row("match",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(p);
+          total += p.match([](long& x) { return x; }, []() { return 0L; });
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { escape(u); total += u ? *u : 0; }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { escape(o); total += o ? *o : 0; }
+      }));
+  row("mutate",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(p);
+          p.mutate([](long x) { return x+1; });
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { escape(u); if (u) *u += 1; }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) { escape(o); if (o) *o += 1; }
+      }));
+  row("map",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(p);
+          auto q = p.map([](long& x) { return x+1; });
+          escape(q);
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(u);
+          auto q = u ? make_unique<long>(*u+1) : nullptr;
+          escape(q);
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(o);
+          auto q = o ? optional<long>(*o+1) : nullopt;
+          escape(q);
+        }
+      }));
+  row("bind",
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(p);
+          auto q = p.bind([](long& x) {
+            return x%2 ? Some<long>(x/2) : Nothing<long>();
+          });
+          escape(q);
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(u);
+          auto q = !u ? nullptr : *u%2 ? make_unique<long>(*u/2) : nullptr;
+          escape(q);
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(o);
+          auto q = !o ? nullopt : *o%2 ? optional<long>(*o/2) : nullopt;
+          escape(q);
+        }
+      }));
+  row("map_move",   // same result type: the heap slot is reused
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(p);
+          p = p.map_move([](long&& x) { return x+1; });
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(u);
+          if (u) *u = *u+1;
+        }
+      }),
+      ns_per_op(Ops, [&]() {
+        for(size_t i=0;i<Ops;i++) {
+          escape(o);
+          if (o) o = move(*o)+1;
+        }
+      }));
+  total += p.match([](long& x) { return x; }, []() { return 0L; });
+  sink = total + *u + *o;
+}//bench_scalar
+
+void bench_arrays(size_t maxn) {
+  cout << "arrays (ns per item, option_ptr<int[]> / vector<int> loop)\n";
+  for(size_t n=1000; n<=maxn; n*=10) {
+    size_t reps = max<size_t>(1,Ops/n);  // about Ops items per measurement
+    auto A = Some_array<int>(n);
+    vector<int> v(n);
+    for(size_t i=0;i<n;i++) v[i] = A[i] = (int)(i*7919 % 1000);
+    long total = 0;
+    double map = ns_per_op(n*reps, [&]() {
+      for(size_t r=0;r<reps;r++) {
+        auto B = A.Map([](int& x) { return 2*x+1; });
+        escape(B);
+      }
+    });
+    double vmap = ns_per_op(n*reps, [&]() {
+      for(size_t r=0;r<reps;r++) {
+        vector<int> w(n);
+        for(size_t i=0;i<n;i++) w[i] = 2*v[i]+1;
+        escape(w);
+      }
+    });
+    double reduce = ns_per_op(n*reps, [&]() {
+      for(size_t r=0;r<reps;r++) {
+        escape(A);
+        total += A.reduce([](int x, int y) { return x+y; }, 0);
+      }
+    });
+    double vreduce = ns_per_op(n*reps, [&]() {
+      for(size_t r=0;r<reps;r++) {
+        escape(v);
+        int s = 0;
+        for(size_t i=0;i<n;i++) s += v[i];
+        total += s;
+      }
+    });
+    double find = ns_per_op(n*reps, [&]() {  // absent: a full scan
+      for(size_t r=0;r<reps;r++) { escape(A); total += A.find(-1); }
+    });
+    double vfind = ns_per_op(n*reps, [&]() {
+      for(size_t r=0;r<reps;r++) {
+        escape(v);
+        total += std::find(v.begin(),v.end(),-1) - v.begin();
+      }
+    });
+    sink = total;
+    printf("  %9zu  Map %5.2f / %5.2f   reduce %5.2f / %5.2f   "
+           "find %5.2f / %5.2f\n", n, map, vmap, reduce, vreduce, find, vfind);
+  }
+}//bench_arrays
+
+// BST against std::set on the same keys (ns per op)
+void bench_tree(const char* name, vector<int>& keys) {
+  size_t n = keys.size();
+  long total = 0;
+  BST<int> tree;
+  set<int> s;
+  double insert = ns_per_op(n, [&]() { for(int k : keys) tree.insert(k); });
+  double sinsert = ns_per_op(n, [&]() { for(int k : keys) s.insert(k); });
+  double contains = ns_per_op(n, [&]() {
+    for(int k : keys) total += tree.contains(k);
+  });
+  double scontains = ns_per_op(n, [&]() {
+    for(int k : keys) total += s.count(k);
+  });
+  double inorder = ns_per_op(n, [&]() {
+    tree.map_inorder([&](int& x) { total += x; });
+  });
+  double sinorder = ns_per_op(n, [&]() { for(int x : s) total += x; });
+  sink = total;
+  printf("  %-14s insert %6.1f / %6.1f   contains %6.1f / %6.1f   "
+         "map_inorder %5.1f / %5.1f\n", name, insert, sinsert, contains,
+         scontains, inorder, sinorder);
+}//bench_tree
+
+int main(int argc, char* argv[]) {
+  size_t maxn = argc>1 ? stoull(argv[1]) : 10000000;
+  bench_scalar();
+  bench_arrays(maxn);
+
+  cout << "trees (ns per op, BST / std::set)\n";
+  mt19937 gen(42);
+  vector<int> random_keys(1000000);
+  for(int& k : random_keys) k = gen();
+  bench_tree("random 1M", random_keys);
+  // sorted keys make the plain BST a list: insert is quadratic
+  vector<int> sorted_keys(10000);
+  for(int i=0;i<10000;i++) sorted_keys[i] = i;
+  bench_tree("sorted 10K", sorted_keys);
+  return 0;
+}//main
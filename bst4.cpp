@@ -3,68 +3,439 @@
 #include<functional>
 #include<concepts>   /* requires -std=c++20 */
 #include<compare>
+#include<bit>
 #include<iostream>
 #include<cassert>
+#include<cmath>
+#include<vector>
+#include<algorithm>
+#include<span>
+#include<atomic>
+#include<mutex>
+#include<thread>
+#include<iterator>
+#include<string_view>
+#include<sstream>
 #include "option_ptr.cpp"
 
+// define BST_NO_MAIN before including this file to use it as a library
+// (as the benchmarks under bench/ do)
+
+////////// node allocation policies
+
+// default policy: every node is allocated on its own with Some
+struct heap_nodes {
+  template<class N> using deleter = pointer_deleter<N>;
+  template<class N, class... Args>
+  option_ptr<N> make(Args&&... args) { return Some<N>(std::forward<Args>(args)...); }
+  template<class N> void reserve(size_t) {}
+  void release() {}
+};
+
+// Allocator handing out memory from a monotonic arena.  Memory is never
+// returned one node at a time, only all at once when the arena is released.
+template<class N>
+struct arena_allocator {
+  using value_type = N;
+  pmr::memory_resource* arena;
+  arena_allocator(pmr::memory_resource* a): arena{a} {}
+  template<class U>
+  arena_allocator(const arena_allocator<U>& other): arena{other.arena} {}
+  N* allocate(size_t n) { return (N*)arena->allocate(n*sizeof(N),alignof(N)); }
+  void deallocate(N*, size_t) {}
+};
+
+// Values in an arena need their destructor run only if they own something
+// outside the arena (a Node does iff its item does, see below).
+template<class N>
+constexpr bool arena_needs_destructor = !is_trivially_destructible<N>::value;
+
+// option_ptrs into an arena keep no state: the allocator is only needed
+// to construct, and dropping a value does not free its memory.  Dropping
+// a tree of trivially destructible items therefore costs nothing.
+template<class TY, class U>
+struct alloc_deleter<TY,arena_allocator<U>> {
+  alloc_deleter() = default;
+  alloc_deleter(const arena_allocator<U>&) {}
+  template<class... Args>
+  static TY* construct(const arena_allocator<U>& alloc, Args&&... args) {
+    return new(arena_allocator<TY>(alloc).allocate(1)) TY(std::forward<Args>(args)...);
+  }
+  static void destruct(TY* p) {
+    if constexpr (arena_needs_destructor<TY>) p->~TY();
+  }
+};
+
+// arena policy: nodes are packed contiguously into large blocks owned by
+// the tree, and the whole tree is released at once
+class arena_nodes {
+private:
+  static constexpr size_t default_bytes = 1<<16;
+  option_ptr<pmr::monotonic_buffer_resource> arena; // stable across moves
+  // the arena, or a new one if this policy was moved from, so that a
+  // moved-from tree stays usable
+  pmr::memory_resource* resource() {
+    if (!arena) arena = Some<pmr::monotonic_buffer_resource>(default_bytes);
+    return arena.match([](pmr::monotonic_buffer_resource& a) {
+                         return (pmr::memory_resource*)&a; },
+                       []() { return (pmr::memory_resource*)nullptr; });
+  }
+public:
+  arena_nodes(size_t initial_bytes = default_bytes)
+    : arena{Some<pmr::monotonic_buffer_resource>(initial_bytes)} {}
+  template<class N> using deleter = alloc_deleter<N,arena_allocator<N>>;
+  template<class N, class... Args>
+  option_ptr<N,deleter<N>> make(Args&&... args) {
+    return Some_in<N>(arena_allocator<N>(resource()),std::forward<Args>(args)...);
+  }
+  // sizes the first block of a fresh arena for count nodes, so that
+  // they all come from a single allocation
+  template<class N> void reserve(size_t count) {
+    if (count>0)
+      arena = Some<pmr::monotonic_buffer_resource>(count*sizeof(N)+alignof(N));
+  }
+  void release() { arena.map_do([](auto& a) { a.release(); }); }
+};
+
+template<class N, class Pool>
+using node_ptr = option_ptr<N,typename Pool::template deleter<N>>;
+
 template<typename T>
 concept ORDERED = requires(T x) { x==x || x<x || x>x; }; //must compile
 
-template<typename T>
-int standard_cmp(T& a, T& b) {
-  if (a==b) return 0;
-  else if (a<b) return -1;
-  else return 1;
-}
-template<typename T>
-int reverse_cmp(T& a, T& b) { return standard_cmp(b,a); }
+// Comparators are callable types: cmp(a,b) returns 0 for ==, -n for <
+// and +m for >.  The trees store a comparator object, which takes no space
+// when it has no state.  A comparator declaring is_transparent can also
+// compare T with other key types, e.g. string with string_view, so that
+// lookups need not build a temporary T.
+template<typename T = void>
+struct standard_cmp {
+  using is_transparent = void;
+  template<class A, class B>
+  int operator()(const A& a, const B& b) const {
+    if (a==b) return 0;
+    else if (a<b) return -1;
+    else return 1;
+  }
+};
+template<typename T = void>
+struct reverse_cmp {
+  using is_transparent = void;
+  template<class A, class B>
+  int operator()(const A& a, const B& b) const { return standard_cmp<T>()(b,a); }
+};
+
+template<class Cmp>
+concept transparent_cmp = requires { typename Cmp::is_transparent; };
 
 // for syntactic convenience (pure syntactic expansion)
-#define node Node<T,cmp>
-#define optnode option_ptr<Node<T,cmp>>
+#define node Node<T,Cmp,Pool>
+#define optnode node_ptr<Node<T,Cmp,Pool>,Pool>
 #define tmatch template match
 #define matchbool template match<bool>
 #define tmap template map
 
-// defines Node class generic with respect to type T and cmp function.
-// cmp function expected to return 0 for ==, -n for < and +m for >.
-template<typename T, int (*cmp)(T&,T&)>
+#if defined(__GNUC__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+// defines Node class generic with respect to type T and comparator type
+// Cmp.  The static functions take the tree's comparator object cmp, and
+// cmp(a,b) is expected to return 0 for ==, -n for < and +m for >.
+// Pool is the node allocation policy, heap_nodes or arena_nodes.
+template<typename T, class Cmp, class Pool = heap_nodes>
 class Node {
 private:
   T item; // value stored at node
-  option_ptr<Node<T,cmp>> left;  // left and right subtrees
-  option_ptr<Node<T,cmp>> right;
+  optnode left;  // left and right subtrees
+  optnode right;
 public:
   // static instance of empty tree (empty optional)
   static const optnode Nil;
   // default constructor
   Node() {} //: item{}, left{}, right{} {}
+  // the item, for reading a node handle (see BST::extract)
+  T& value() { return item; }
   // Single node constructor
-  Node(T x) : item{x}, left{optnode()}, right{optnode()} {}
+  Node(T x) : item{move(x)}, left{optnode()}, right{optnode()} {}
+
+  // Iterative versions of insert and search, used by BST: they walk the
+  // links from t without recursion and without copying x.  The lambda
+  // passed to map_do only records the address of the node and is inlined.
+  static bool insert_at(optnode& t, const T& x, Pool& pool, const Cmp& cmp) {
+    node* n = nullptr;
+    t.map_do([&n](node& m) { n = &m; });
+    if (!n) { t = pool.template make<node>(x); return true; }
+    while (true) {
+      int c = cmp(x,n->item);
+      if (c==0) return false;
+      node* next = nullptr;
+      if (c<0) {
+        n->left.map_do([&next](node& m) { next = &m; });
+        if (!next) { n->left = pool.template make<node>(x); return true; }
+      }
+      else {
+        n->right.map_do([&next](node& m) { next = &m; });
+        if (!next) { n->right = pool.template make<node>(x); return true; }
+      }
+      n = next;
+    }
+  }//insert_at
 
-  bool insert(T x) {  // returns true if inserted
+  // the link holding the node with item x, or the empty link where x
+  // would be inserted
+  static optnode* link_to(optnode& t, const T& x, const Cmp& cmp) {
+    optnode* link = &t;
+    for(node* n = node_of(t); n; n = node_of(*link)) {
+      int c = cmp(x,n->item);
+      if (c==0) break;
+      link = c<0 ? &n->left : &n->right;
+    }
+    return link;
+  }
+
+  // Detaches the node with item x and returns it, childless, or Nil.  Its
+  // place is taken by its only subtree or by its in-order successor; no
+  // node is copied, allocated or freed, only links are moved.
+  static optnode extract_from(optnode& t, const T& x, const Cmp& cmp) {
+    optnode* link = link_to(t,x,cmp);
+    node* n = node_of(*link);
+    if (!n) return optnode();
+    optnode replacement;
+    if (!n->left) replacement = move(n->right);
+    else if (!n->right) replacement = move(n->left);
+    else {
+      optnode* s = &n->right;  // link to the successor: leftmost on the right
+      while (node_of(*s)->left) s = &node_of(*s)->left;
+      optnode sright = move(node_of(*s)->right);
+      replacement = move(*s);
+      *s = move(sright);
+      node* m = node_of(replacement);
+      m->left = move(n->left);
+      m->right = move(n->right);
+    }
+    optnode h = move(*link);
+    *link = move(replacement);
+    return h;
+  }//extract_from
+
+  // Links the childless node h into t; false (h untouched) if its item
+  // is already there.
+  static bool insert_node(optnode& t, optnode& h, const Cmp& cmp) {
+    node* n = node_of(h);
+    if (!n) return false;
+    optnode* link = link_to(t,n->item,cmp);
+    if (*link) return false;
+    *link = move(h);
+    return true;
+  }
+
+  // K is T, or any key type cmp compares with T (see transparent_cmp)
+  template<class K>
+  static bool search_in(optnode& t, const K& x, const Cmp& cmp) {
+    node* n = nullptr;
+    t.map_do([&n](node& m) { n = &m; });
+    while (n) {
+      int c = cmp(x,n->item);
+      if (c==0) return true;
+      node* next = nullptr;
+      if (c<0) n->left.map_do([&next](node& m) { next = &m; });
+      else n->right.map_do([&next](node& m) { next = &m; });
+      n = next;
+    }
+    return false;
+  }//search_in
+
+  // Batched lookups: up to Group searches walk down the tree together,
+  // one level per round, and the next node of each is prefetched, so the
+  // cache misses of the searches overlap instead of adding up.
+  static constexpr size_t Group = 16;
+
+  static node* node_of(optnode& t) {
+    node* n = nullptr;
+    t.map_do([&n](node& m) { n = &m; });
+    return n;
+  }
+
+  static void search_many(optnode& t, span<const T> keys, span<bool> out,
+                          const Cmp& cmp) {
+    node* root = node_of(t);
+    for(size_t base=0; base<keys.size(); base+=Group) {
+      size_t g = min(Group,keys.size()-base);
+      node* cur[Group];
+      for(size_t i=0;i<g;i++) { cur[i] = root; out[base+i] = false; }
+      for(size_t active=(root?g:0); active>0; ) {
+        active = 0;
+        for(size_t i=0;i<g;i++) {
+          node* n = cur[i];
+          if (!n) continue;
+          int c = cmp(keys[base+i],n->item);
+          if (c==0) { out[base+i] = true; cur[i] = nullptr; continue; }
+          cur[i] = node_of(c<0 ? n->left : n->right);
+          if (cur[i]) { PREFETCH(cur[i]); active++; }
+        }
+      }
+    }
+  }//search_many
+
+  // for each key, the smallest item not less than it, if there is one
+  static void lower_bound_many(optnode& t, span<const T> keys,
+                               span<T> out, span<bool> found, const Cmp& cmp) {
+    node* root = node_of(t);
+    for(size_t base=0; base<keys.size(); base+=Group) {
+      size_t g = min(Group,keys.size()-base);
+      node* cur[Group];
+      node* best[Group];
+      for(size_t i=0;i<g;i++) { cur[i] = root; best[i] = nullptr; }
+      for(size_t active=(root?g:0); active>0; ) {
+        active = 0;
+        for(size_t i=0;i<g;i++) {
+          node* n = cur[i];
+          if (!n) continue;
+          int c = cmp(keys[base+i],n->item);
+          if (c==0) { best[i] = n; cur[i] = nullptr; continue; }
+          if (c<0) best[i] = n;
+          cur[i] = node_of(c<0 ? n->left : n->right);
+          if (cur[i]) { PREFETCH(cur[i]); active++; }
+        }
+      }
+      for(size_t i=0;i<g;i++) {
+        found[base+i] = best[i]!=nullptr;
+        if (best[i]) out[base+i] = best[i]->item;
+      }
+    }
+  }//lower_bound_many
+
+  // In-order bidirectional iterator.  It keeps the path from the root
+  // to the current node on an explicit stack, so it needs no parent links
+  // and no recursion, and can be paused, resumed or stopped at any point.
+  // Inserting items does not invalidate it, erasing items does.
+  class iterator {
+  private:
+    vector<node*> path;  // root ... current node; empty at the end
+    node* root;
+    friend class Node;
+
+    void push_leftmost(node* n) {
+      for(; n; n = node_of(n->left)) path.push_back(n);
+    }
+    void push_rightmost(node* n) {
+      for(; n; n = node_of(n->right)) path.push_back(n);
+    }
+    // pops nodes while the popped node is the `side` child of its parent
+    template<class Side>
+    void pop_while(Side side) {
+      node* child;
+      do {
+        child = path.back();
+        path.pop_back();
+      } while (!path.empty() && node_of(side(*path.back()))==child);
+    }
+  public:
+    using iterator_category = bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    iterator(node* r = nullptr) : root{r} {}
+
+    T& operator *() const { return path.back()->item; }
+    T* operator ->() const { return &path.back()->item; }
+
+    iterator& operator ++() {
+      node* r = node_of(path.back()->right);
+      if (r) push_leftmost(r);
+      else pop_while([](node& p) -> optnode& { return p.right; });
+      return *this;
+    }
+    iterator& operator --() {  // --end() is the last item
+      if (path.empty()) { push_rightmost(root); return *this; }
+      node* l = node_of(path.back()->left);
+      if (l) push_rightmost(l);
+      else pop_while([](node& p) -> optnode& { return p.left; });
+      return *this;
+    }
+    iterator operator ++(int) { iterator old = *this; ++*this; return old; }
+    iterator operator --(int) { iterator old = *this; --*this; return old; }
+
+    bool operator ==(const iterator& other) const {
+      return (path.empty() ? nullptr : path.back()) ==
+             (other.path.empty() ? nullptr : other.path.back());
+    }
+  };//iterator
+
+  static iterator begin_of(optnode& t) {
+    iterator it(node_of(t));
+    it.push_leftmost(it.root);
+    return it;
+  }
+  static iterator end_of(optnode& t) { return iterator(node_of(t)); }
+
+  // first item not less than x (strict: greater than x); only the nodes on
+  // one root-to-leaf path are visited
+  static iterator bound_of(optnode& t, const T& x, bool strict,
+                           const Cmp& cmp) {
+    iterator it(node_of(t));
+    size_t found = 0;  // length of the path up to the best node so far
+    for(node* n = it.root; n; ) {
+      it.path.push_back(n);
+      int c = cmp(x,n->item);
+      if (c<0 || (c==0 && !strict)) {
+        found = it.path.size();
+        if (c==0) break;
+        n = node_of(n->left);
+      }
+      else n = node_of(n->right);
+    }
+    it.path.resize(found);
+    return it;
+  }
+
+  // Builds a perfectly balanced tree from the next n distinct items of a
+  // sorted sequence, in order and without comparisons.  Equal neighbours
+  // in the sequence are skipped (counted as one item by the caller).
+  template<class It>
+  static optnode build(size_t n, It& it, It end, Pool& pool, const Cmp& cmp) {
+    if (n==0) return optnode();
+    optnode l = build(n/2,it,end,pool,cmp);
+    optnode t = pool.template make<node>(*it);
+    const T& prev = *it;
+    for(++it; it!=end && cmp(prev,*it)==0; ++it);
+    t.map_do([&](node& m) {
+      m.left = move(l);
+      m.right = build(n-n/2-1,it,end,pool,cmp);
+    });
+    return t;
+  }//build
+
+  // recursive insert and search on the subtree rooted at this node
+
+  bool insert(T x, Pool& pool, const Cmp& cmp) {  // returns true if inserted
     int c = cmp(x,item);
     if (c<0) {// x<item
       return 
-      left.matchbool([x](node& n){ return n.insert(x);},
-   	             [x,this](){this->left=Some<node>(x); return true;});
+      left.matchbool([x,&pool,&cmp](node& n){ return n.insert(x,pool,cmp);},
+   	             [x,&pool,this](){this->left=pool.template make<node>(x); return true;});
     }
     else if (c>0) { // x>item
       return
-      right.matchbool([x](node& n){return n.insert(x);},
-                      [x,this](){this->right=Some<node>(x); return true;});
+      right.matchbool([x,&pool,&cmp](node& n){return n.insert(x,pool,cmp);},
+                      [x,&pool,this](){this->right=pool.template make<node>(x); return true;});
     }
     else return false;
   }//insert
 
-  bool search(T& x) { //binary search
+  bool search(T& x, const Cmp& cmp) { //binary search
     int c = cmp(x,item);
     if (c==0) return true;
     else if (c<0)
-      return left.matchbool([&x](node& n){return n.search(x);},
+      return left.matchbool([&x,&cmp](node& n){return n.search(x,cmp);},
  		            [](){return false;});
     else
-      return right.matchbool([&x](node& n){return n.search(x);},
+      return right.matchbool([&x,&cmp](node& n){return n.search(x,cmp);},
 		             [](){return false;});
   }//search
 
@@ -74,14 +445,51 @@ public:
     f(item);
     right.map_do([&f](node& n){n.map_inorder(f);});    
   }
+
+  // as map_inorder, with the callable inlined
+  template<class F>
+  void visit_inorder(F& f) {
+    left.map_do([&f](node& n){n.visit_inorder(f);});
+    f(item);
+    right.map_do([&f](node& n){n.visit_inorder(f);});
+  }
+
+  // For parallel traversal the tree is cut into an in-order list of
+  // segments: the whole subtrees found `levels` below t, and the single
+  // items of the nodes above them.
+  struct segment { node* n; bool whole; };
+
+  static void cut(optnode& t, int levels, vector<segment>& out) {
+    t.map_do([&](node& n) {
+      if (levels==0) { out.push_back({&n,true}); return; }
+      cut(n.left,levels-1,out);
+      out.push_back({&n,false});
+      cut(n.right,levels-1,out);
+    });
+  }
+
+  template<class F>
+  void visit_segment(bool whole, F& f) {
+    if (whole) visit_inorder(f); else f(item);
+  }
   
 };// Node class
 
+template<typename T, class Cmp, class Pool>
+constexpr bool arena_needs_destructor<Node<T,Cmp,Pool>> =
+  !is_trivially_destructible<T>::value;
+
+template<ORDERED T, class Cmp>
+class FrozenBST;
+
 // wrapper class, `ORDERED T` same as ... requires ORDERED<T>
-template<ORDERED T, int (*cmp)(T&,T&) = standard_cmp<T>>
+// BST<T,Cmp,arena_nodes> allocates its nodes from an arena it owns.
+template<ORDERED T, class Cmp = standard_cmp<T>, class Pool = heap_nodes>
 class BST {
 private:
-  option_ptr<Node<T,cmp>> root;
+  [[no_unique_address]] Pool pool;  // declared first: outlives the nodes
+  [[no_unique_address]] Cmp cmp;
+  optnode root;
   size_t count;
   /*
   static optnode insert(optnode& current, T x) {
@@ -96,55 +504,887 @@ private:
   }//insert
   */
 public:
-  BST() : root{optnode()}, count{0} {} // default constructor makes empty tree
+  BST() : cmp{}, root{optnode()}, count{0} {} // default constructor makes empty tree
+  // empty tree ordered by a given comparator object
+  explicit BST(Cmp c) : cmp{move(c)}, root{optnode()}, count{0} {}
+
+private:
+  template<class It>
+  static BST from_sorted(It first, It end, Cmp c) {
+    size_t n = 0;  // number of distinct items
+    for(It i=first; i!=end; ) {
+      const T& prev = *i;
+      for(++i; i!=end && c(prev,*i)==0; ++i);
+      n++;
+    }
+    BST tree(move(c));
+    tree.pool.template reserve<node>(n);
+    tree.root = node::build(n,first,end,tree.pool,tree.cmp);
+    tree.count = n;
+    return tree;
+  }
+public:
 
   size_t size() { return count; }
+  const Cmp& comparator() const { return cmp; }
 
-  bool insert(T x) {
-      bool inserted = false; 
-      root.match_do([x,&inserted](node& n) { inserted = n.insert(x);},
-		    [x,this,&inserted]() {
-		      this->root = Some<node>(x);
-		      inserted = true;
-		    });
+  // Bulk construction in O(n): builds a perfectly balanced tree from a
+  // range sorted under c (duplicates are allowed and kept once).  With
+  // arena_nodes all nodes come from one allocation.
+  template<class R>
+  static BST from_sorted(R&& range, Cmp c = Cmp()) {
+    auto it = std::begin(range), end = std::end(range);
+    return from_sorted(it,end,move(c));
+  }
+  template<class D>
+  static BST from_sorted(option_ptr<T[],D>& A, Cmp c = Cmp()) {
+    if (A.size()==0) return BST(move(c));
+    T* first = &A[0];
+    return from_sorted(first,first+A.size(),move(c));
+  }
+
+  // Bulk construction from an unsorted range: sorts a copy, then builds
+  // as from_sorted, in O(n log n).
+  template<class R>
+  static BST from_range(R&& range, Cmp c = Cmp()) {
+    vector<T> items(std::begin(range),std::end(range));
+    sort(items.begin(),items.end(),[&c](T& a, T& b) { return c(a,b)<0; });
+    return from_sorted(items,move(c));
+  }
+  template<class D>
+  static BST from_range(option_ptr<T[],D>& A, Cmp c = Cmp()) {
+    option_ptr<T[]> items;  // a heap copy, whatever the storage of A
+    items.reserve(A.size());
+    A.foreach([&items](T& x) { items.push_back(x); });
+    items.sort([&c](const T& a, const T& b) { return c(a,b)<0; });
+    return from_sorted(items,move(c));
+  }
+
+  bool insert(const T& x) {
+    bool inserted = node::insert_at(root,x,pool,cmp);
     if (inserted) count++;
     return inserted;
   }//insert
 
-  bool contains(T& x) {
-     return root.matchbool([&x](node& n) {return n.search(x);},
-  		           []() {return false;});
-  }//contains
+  bool contains(const T& x) { return node::search_in(root,x,cmp); }
+  // lookup by any key type a transparent comparator accepts, e.g. a
+  // string_view in a BST<string>, without building a temporary T
+  template<class K> requires transparent_cmp<Cmp>
+  bool contains(const K& x) { return node::search_in(root,x,cmp); }
+
+  ////// Erasure and node handles.  A node handle owns one detached node;
+  // it can be inserted back into any tree of the same type.  With
+  // heap_nodes the node itself is moved, without allocating or copying its
+  // item.  With arena_nodes a node cannot leave the arena of its tree, so
+  // extract moves the item into a heap node of its own, and insert copies
+  // it into a node of the receiving tree's arena: the handle never
+  // depends on the tree it came from.
+  using node_handle = node_ptr<Node<T,Cmp,heap_nodes>,heap_nodes>;
+
+  // removes x; false if it was not there
+  bool erase(const T& x) {
+    bool found = node::extract_from(root,x,cmp);  // the node is dropped here
+    if (found) count--;
+    return found;
+  }
+
+  // removes x and returns its node, or Nil if x was not there
+  node_handle extract(const T& x) {
+    optnode n = node::extract_from(root,x,cmp);
+    if (n) count--;
+    if constexpr (is_same<Pool,heap_nodes>::value) return n;
+    else {
+      node_handle h;
+      n.map_do([&h](node& m) {
+        h = Some<Node<T,Cmp,heap_nodes>>(move(m.value()));
+      });
+      return h;
+    }
+  }
+
+  // inserts the node held by h and empties h; if its item is already in
+  // the tree (or h is Nil) returns false and leaves h as it was
+  bool insert(node_handle&& h) {
+    bool inserted;
+    if constexpr (is_same<Pool,heap_nodes>::value)
+      inserted = node::insert_node(root,h,cmp);
+    else {
+      T* x = nullptr;
+      h.map_do([&x](Node<T,Cmp,heap_nodes>& n) { x = &n.value(); });
+      inserted = x && node::insert_at(root,*x,pool,cmp);
+      if (inserted) h.drop();
+    }
+    if (inserted) count++;
+    return inserted;
+  }
+
+  ////// In-order iteration: for(auto& x : tree) ...
+  // Items must not be modified in a way that changes their order.
+  using iterator = typename node::iterator;
+  iterator begin() { return node::begin_of(root); }
+  iterator end() { return node::end_of(root); }
+  iterator lower_bound(const T& x) { return node::bound_of(root,x,false,cmp); }
+  iterator upper_bound(const T& x) { return node::bound_of(root,x,true,cmp); }
+
+  // the items in [lo,hi), for range scans: for(auto& x : tree.range(lo,hi))
+  struct item_range {
+    iterator first, last;
+    iterator begin() { return first; }
+    iterator end() { return last; }
+  };
+  item_range range(const T& lo, const T& hi) {
+    return item_range{lower_bound(lo),lower_bound(hi)};
+  }
+
+  // out[i] = contains(keys[i]), with the lookups of a batch interleaved
+  void contains_many(span<const T> keys, span<bool> out) {
+    assert(out.size()>=keys.size());
+    node::search_many(root,keys,out,cmp);
+  }
+
+  // out[i] = smallest item >= keys[i] and found[i] = true, or found[i] =
+  // false if every item is less than keys[i]
+  void lower_bound_many(span<const T> keys, span<T> out, span<bool> found) {
+    assert(out.size()>=keys.size() && found.size()>=keys.size());
+    node::lower_bound_many(root,keys,out,found,cmp);
+  }
   bool contains_val(T x) { return contains(x); }
 
   void map_inorder(function<void(T&)> f) {
     root.map_do([&f](node& n ){n.map_inorder(f);});
   }
 
+  // the items in order, in a new array
+  option_ptr<T[]> sorted_items() {
+    option_ptr<T[]> A;
+    A.reserve(count);
+    auto add = [&A](T& x) { A.push_back(x); };
+    root.map_do([&add](node& n) { n.visit_inorder(add); });
+    return A;
+  }
+
+  ////// Binary persistence, for trivially copyable T: the tree is saved
+  // as its sorted items (see option_ptr<T[]>::write), and loading rebuilds
+  // it with the O(n) bulk build of from_sorted, without searching or
+  // rebalancing; load with the comparator the tree was saved with.  An
+  // empty tree is returned if the data cannot be read.
+  bool save(ostream& out) { return sorted_items().write(out); }
+  bool save(const string& path) { return sorted_items().save(path); }
+  static BST load(istream& in, Cmp c = Cmp()) {
+    option_ptr<T[]> A = Some_read<T>(in);
+    return from_sorted(A,move(c));
+  }
+  // the file is mapped into memory rather than read into a buffer
+  static BST load(const string& path, Cmp c = Cmp()) {
+#ifdef OPTION_PTR_MMAP
+    auto A = Some_mapped_saved<T>(path);
+#else
+    auto A = Some_read<T>(path);
+#endif
+    return from_sorted(A,move(c));
+  }
+
+  ////// Parallel traversal.  The tree is cut into about 8 segments per
+  // thread, which idle threads take from a shared counter, so that threads
+  // finishing small subtrees early keep taking work.  Segments are even
+  // in a balanced tree (e.g. one built by from_sorted), uneven in a
+  // degenerate one.  The tree must not be modified meanwhile.
+
+  // applies f to every item, concurrently and in no particular order
+  template<class F>
+  void parallel_for_each(F f, unsigned threads = 0) {
+    vector<typename node::segment> segs = segments(threads);
+    run_parallel(segs.size(),threads,[&](size_t i) {
+      segs[i].n->visit_segment(segs[i].whole,f);
+    });
+  }
+
+  // Reduces the items with f, which must be associative and have id as
+  // its identity.  Segments are reduced in parallel and their results
+  // merged in order, so f need not be commutative: the result equals
+  // f(...f(f(id,x1),x2)...,xn) for the items x1 < x2 < ... < xn.
+  template<class F>
+  T parallel_reduce(F f, T id, unsigned threads = 0) {
+    vector<typename node::segment> segs = segments(threads);
+    vector<T> partial(segs.size(),id);
+    run_parallel(segs.size(),threads,[&](size_t i) {
+      T acc = id;  // local, so threads do not share cache lines meanwhile
+      auto step = [&](T& x) { acc = f(acc,x); };
+      segs[i].n->visit_segment(segs[i].whole,step);
+      partial[i] = move(acc);
+    });
+    T result = id;
+    for(T& p : partial) result = f(result,p);
+    return result;
+  }
+
+private:
+  vector<typename node::segment> segments(unsigned& threads) {
+    if (threads==0) threads = max(1u,thread::hardware_concurrency());
+    int levels = 0;
+    while ((1u<<levels) < 8*threads) levels++;
+    vector<typename node::segment> segs;
+    node::cut(root,levels,segs);
+    return segs;
+  }
+
+  // runs task(0..tasks-1) on `threads` threads (this one included)
+  template<class F>
+  static void run_parallel(size_t tasks, unsigned threads, F&& task) {
+    atomic<size_t> next{0};
+    auto worker = [&]() {
+      for(size_t i; (i = next.fetch_add(1)) < tasks; ) task(i);
+    };
+    vector<thread> pool;
+    for(unsigned t=1; t<threads && t<tasks; t++) pool.emplace_back(worker);
+    worker();
+    for(thread& th : pool) th.join();
+  }
+public:
+
+  // read-only snapshot of the current items in a flat array; call again
+  // to rebuild it after the tree has changed
+  FrozenBST<T,Cmp> freeze() { return FrozenBST<T,Cmp>(*this); }
+
+  // removes all items; with arena_nodes the memory of all nodes is
+  // released at once (without visiting them if T is trivially destructible)
+  void clear() {
+    root.drop();
+    count = 0;
+    pool.release();
+  }
+
   // default move semantics (code is redundant, just for emphasis)
-  // BST(BST<T,cmp>&& other) = default;
-  // BST<T,cmp>& operator=(BST<T,cmp>&& other) = default;
+  // BST(BST<T,Cmp>&& other) = default;
+  // BST<T,Cmp>& operator=(BST<T,Cmp>&& other) = default;
   
   ////// custom move semantics
-  BST(BST<T,cmp>&& other) {  // move constructor
+  BST(BST&& other): pool{move(other.pool)}, cmp{move(other.cmp)} {  // move constructor
     root = move(other.root);
     count = other.count;
     other.count = 0;
   }
-  BST<T,cmp>& operator = (BST<T,cmp>&& other) {  // move assignment
-    root = move(other.root);
+  BST& operator = (BST&& other) {  // move assignment
+    root = move(other.root);  // old nodes dropped before their pool
+    pool = move(other.pool);
+    cmp = move(other.cmp);
     count = other.count;
     other.count = 0;   
+    return *this;
   }// move semantics of BST
 
 }; // BST wrapper class
 
 
+////////// Frozen, read-only snapshot of a BST
+
+// The items of a tree in one contiguous option_ptr<T[]>, in Eytzinger
+// (breadth-first) order: the children of slot k are slots 2k and 2k+1, so
+// the top levels of every search share the same few cache lines.  Search
+// is branch-free.  A FrozenBST is never modified after construction, so
+// any number of threads can search it concurrently without locking.
+// Items must be default constructible.
+template<ORDERED T, class Cmp = standard_cmp<T>>
+class FrozenBST {
+private:
+  [[no_unique_address]] Cmp cmp;
+  option_ptr<T[]> items;  // slots 1..n used, slot 0 unused
+  size_t n;
+
+  // places sorted[i...] into the subtree rooted at slot k, in order
+  void fill(option_ptr<T[]>& sorted, size_t& i, size_t k) {
+    if (k>n) return;
+    fill(sorted,i,2*k);
+    items[k] = move(sorted[i++]);
+    fill(sorted,i,2*k+1);
+  }
+
+  void inorder(size_t k, function<void(T&)>& f) {
+    if (k>n) return;
+    inorder(2*k,f);
+    f(items[k]);
+    inorder(2*k+1,f);
+  }
+
+  // slot of the first item not less than x, or 0 if there is none
+  template<class K>
+  size_t lower_slot(const K& x) const {
+    size_t k = 1;
+    while (k<=n) {
+      PREFETCH(&items[0] + min(16*k,n));  // 4 levels ahead
+      k = 2*k + (cmp(items[k],x)<0);
+    }
+    k >>= countr_one(k)+1;  // undo the right turns after the answer
+    return k;
+  }
+
+public:
+  FrozenBST() : n{0} {}
+
+  template<class Pool>
+  FrozenBST(BST<T,Cmp,Pool>& tree) : cmp{tree.comparator()}, n{tree.size()} {
+    if (n==0) return;
+    option_ptr<T[]> sorted = Some_array<T>(n);
+    size_t i = 0;
+    tree.map_inorder([&](T& x) { sorted[i++] = x; });
+    items = Some_array<T>(n+1);
+    i = 0;
+    fill(sorted,i,1);
+  }
+
+  size_t size() const { return n; }
+
+  bool contains(const T& x) const {
+    size_t k = lower_slot(x);
+    return k!=0 && cmp(items[k],x)==0;
+  }
+  template<class K> requires transparent_cmp<Cmp>
+  bool contains(const K& x) const {
+    size_t k = lower_slot(x);
+    return k!=0 && cmp(items[k],x)==0;
+  }
+  bool contains_val(T x) const { return contains(x); }
+
+  // smallest item not less than x, if any
+  option_ptr<T> lower_bound(const T& x) const {
+    size_t k = lower_slot(x);
+    if (k==0) return Nothing<T>();
+    return Some<T>(items[k]);
+  }
+
+  // Batched lookups: all searches of a group descend in lockstep.  The
+  // inner loop has no data-dependent branches, so the compiler can turn
+  // it into SIMD compares and gathers (e.g. with -mavx2 for 32/64-bit keys).
+  void contains_many(span<const T> keys, span<bool> out) const {
+    assert(out.size()>=keys.size());
+    if (n==0) { for(size_t i=0;i<keys.size();i++) out[i] = false; return; }
+    constexpr size_t G = 16;
+    int levels = 0;
+    for(size_t m=n; m>0; m>>=1) levels++;  // depth of the deepest slot
+    const T* b = &items[0];
+    for(size_t base=0; base<keys.size(); base+=G) {
+      size_t g = min(G,keys.size()-base);
+      size_t k[G];
+      for(size_t i=0;i<g;i++) k[i] = 1;
+      for(int level=0; level<levels; level++)
+        for(size_t i=0;i<g;i++) {
+          size_t ki = k[i]<=n ? k[i] : 0;  // slot 0 is a harmless stand-in
+          size_t next = 2*k[i] + (cmp(b[ki],keys[base+i])<0);
+          k[i] = k[i]<=n ? next : k[i];
+        }
+      for(size_t i=0;i<g;i++) {
+        size_t ki = k[i] >> (countr_one(k[i])+1);
+        out[base+i] = ki!=0 && cmp(b[ki],keys[base+i])==0;
+      }
+    }
+  }//contains_many
+
+  void map_inorder(function<void(T&)> f) { inorder(1,f); }
+
+  // rebuilds the snapshot from the current contents of a tree
+  template<class Pool>
+  void rebuild(BST<T,Cmp,Pool>& tree) { *this = FrozenBST(tree); }
+
+  FrozenBST(FrozenBST&& other)
+    : cmp{move(other.cmp)}, items{move(other.items)}, n{other.n} {
+    other.n = 0;
+  }
+  FrozenBST& operator = (FrozenBST&& other) {
+    cmp = move(other.cmp);
+    items = move(other.items);
+    n = other.n;
+    other.n = 0;
+    return *this;
+  }
+}; // FrozenBST class
+
+
+////////// Self-balancing (AVL) variant of BST
+
+#define avlnode AVLNode<T,Cmp,Pool>
+#define optavl node_ptr<AVLNode<T,Cmp,Pool>,Pool>
+
+// AVL tree node: subtree heights differ by at most one, so the height of
+// a tree of n nodes is below 1.45*log2(n).  All restructuring is done by
+// moving the option_ptr links; nodes and items are never copied.
+template<typename T, class Cmp, class Pool = heap_nodes>
+class AVLNode {
+private:
+  T item;
+  optavl left;
+  optavl right;
+  int height;  // height of the subtree rooted here, leaf = 1
+
+  static int height_of(optavl& t) {
+    return t.tmatch([](avlnode& n) { return n.height; }, []() { return 0; });
+  }
+  void update() { height = 1 + max(height_of(left),height_of(right)); }
+  int balance() { return height_of(left)-height_of(right); }
+
+  static void rotate_right(optavl& t) {  // t and t.left must exist
+    t.map_do([&t](avlnode& n) {
+      optavl l = move(n.left);
+      l.map_do([&](avlnode& ln) {
+        n.left = move(ln.right);
+        n.update();
+        ln.right = move(t);
+        ln.update();
+      });
+      t = move(l);
+    });
+  }//rotate_right
+
+  static void rotate_left(optavl& t) {  // t and t.right must exist
+    t.map_do([&t](avlnode& n) {
+      optavl r = move(n.right);
+      r.map_do([&](avlnode& rn) {
+        n.right = move(rn.left);
+        n.update();
+        rn.left = move(t);
+        rn.update();
+      });
+      t = move(r);
+    });
+  }//rotate_left
+
+  // restores the AVL property at t after one of its subtrees changed
+  static void rebalance(optavl& t) {
+    t.map_do([&t](avlnode& n) {
+      int b = n.balance();
+      if (b>1) {
+        if (n.left.tmatch([](avlnode& l){return l.balance();},[](){return 0;})<0)
+          rotate_left(n.left);
+        rotate_right(t);
+      }
+      else if (b<-1) {
+        if (n.right.tmatch([](avlnode& r){return r.balance();},[](){return 0;})>0)
+          rotate_right(n.right);
+        rotate_left(t);
+      }
+      else n.update();
+    });
+  }//rebalance
+
+  // detaches the node with the smallest item from t and returns it
+  static optavl extract_min(optavl& t) {
+    optavl m;
+    t.map_do([&](avlnode& n) {
+      if (n.left) {
+        m = extract_min(n.left);
+        rebalance(t);
+      }
+      else {
+        optavl r = move(n.right);
+        m = move(t);
+        t = move(r);
+      }
+    });
+    m.map_do([](avlnode& mn) { mn.height = 1; });
+    return m;
+  }//extract_min
+
+public:
+  AVLNode(T x) : item{move(x)}, left{optavl()}, right{optavl()}, height{1} {}
+
+  static bool insert(optavl& t, T& x, Pool& pool, const Cmp& cmp) {  // true if inserted
+    bool inserted =
+      t.matchbool([&](avlnode& n) {
+                    int c = cmp(x,n.item);
+                    if (c<0) return insert(n.left,x,pool,cmp);
+                    else if (c>0) return insert(n.right,x,pool,cmp);
+                    else return false;
+                  },
+                  [&]() { t = pool.template make<avlnode>(x); return true; });
+    if (inserted) rebalance(t);
+    return inserted;
+  }//insert
+
+  // true if x was found and removed
+  static bool erase(optavl& t, const T& x, const Cmp& cmp) {
+    bool erased =
+      t.matchbool([&](avlnode& n) {
+                    int c = cmp(x,n.item);
+                    if (c<0) return erase(n.left,x,cmp);
+                    if (c>0) return erase(n.right,x,cmp);
+                    optavl replacement;
+                    if (!n.left) replacement = move(n.right);
+                    else if (!n.right) replacement = move(n.left);
+                    else {  // two children: successor node takes n's place
+                      replacement = extract_min(n.right);
+                      replacement.map_do([&n](avlnode& s) {
+                        s.left = move(n.left);
+                        s.right = move(n.right);
+                      });
+                    }
+                    t = move(replacement);  // drops n, n is gone from here on
+                    return true;
+                  },
+                  []() { return false; });
+    if (erased) rebalance(t);
+    return erased;
+  }//erase
+
+  template<class K>
+  static bool search(optavl& t, const K& x, const Cmp& cmp) {  // iterative, as Node::search_in
+    avlnode* n = nullptr;
+    t.map_do([&n](avlnode& m) { n = &m; });
+    while (n) {
+      int c = cmp(x,n->item);
+      if (c==0) return true;
+      avlnode* next = nullptr;
+      if (c<0) n->left.map_do([&next](avlnode& m) { next = &m; });
+      else n->right.map_do([&next](avlnode& m) { next = &m; });
+      n = next;
+    }
+    return false;
+  }//search
+
+  static int height_of_tree(optavl& t) { return height_of(t); }
+
+  void map_inorder(function<void(T&)>& f) {
+    left.map_do([&f](avlnode& n){n.map_inorder(f);});
+    f(item);
+    right.map_do([&f](avlnode& n){n.map_inorder(f);});
+  }
+};// AVLNode class
+
+template<typename T, class Cmp, class Pool>
+constexpr bool arena_needs_destructor<AVLNode<T,Cmp,Pool>> =
+  !is_trivially_destructible<T>::value;
+
+// Same interface as BST, plus erase, with guaranteed O(log n) height.
+template<ORDERED T, class Cmp = standard_cmp<T>, class Pool = heap_nodes>
+class BalancedBST {
+private:
+  [[no_unique_address]] Pool pool;  // declared first: outlives the nodes
+  [[no_unique_address]] Cmp cmp;
+  optavl root;
+  size_t count;
+public:
+  BalancedBST() : cmp{}, root{optavl()}, count{0} {}
+  explicit BalancedBST(Cmp c) : cmp{move(c)}, root{optavl()}, count{0} {}
+
+  size_t size() { return count; }
+  int height() { return avlnode::height_of_tree(root); }
+
+  bool insert(T x) {
+    bool inserted = avlnode::insert(root,x,pool,cmp);
+    if (inserted) count++;
+    return inserted;
+  }//insert
+
+  bool erase(const T& x) {
+    bool erased = avlnode::erase(root,x,cmp);
+    if (erased) count--;
+    return erased;
+  }//erase
+  bool erase_val(T x) { return erase(x); }
+
+  bool contains(const T& x) { return avlnode::search(root,x,cmp); }
+  template<class K> requires transparent_cmp<Cmp>
+  bool contains(const K& x) { return avlnode::search(root,x,cmp); }
+  bool contains_val(T x) { return contains(x); }
+
+  void map_inorder(function<void(T&)> f) {
+    root.map_do([&f](avlnode& n){n.map_inorder(f);});
+  }
+
+  void clear() {
+    root.drop();
+    count = 0;
+    pool.release();
+  }
+
+  BalancedBST(BalancedBST&& other): pool{move(other.pool)}, cmp{move(other.cmp)} {
+    root = move(other.root);
+    count = other.count;
+    other.count = 0;
+  }
+  BalancedBST& operator = (BalancedBST&& other) {
+    root = move(other.root);
+    pool = move(other.pool);
+    cmp = move(other.cmp);
+    count = other.count;
+    other.count = 0;
+    return *this;
+  }
+}; // BalancedBST wrapper class
+
+
+////////// B-tree: wide nodes for better cache density
+
+#define bnode BNode<T,Cmp,Fanout,Pool>
+#define optbnode node_ptr<BNode<T,Cmp,Fanout,Pool>,Pool>
+
+// A B-tree node holds up to Fanout-1 sorted items in one contiguous block
+// and Fanout children, so a lookup touches about log_Fanout(n) nodes
+// instead of log_2(n).  Every node except the root holds at least
+// Fanout/2-1 items.  Items must be default constructible.
+template<typename T, class Cmp, int Fanout, class Pool>
+class BNode {
+private:
+  static constexpr int MaxItems = Fanout-1;
+  static constexpr int MinDegree = Fanout/2;  // "t" in the usual B-tree terms
+  int n;             // number of items in use
+  T items[MaxItems]; // items[0..n-1] in increasing order
+  optbnode child[Fanout]; // child[i] holds items between items[i-1] and items[i]
+
+  static bnode* node_of(optbnode& t) {
+    bnode* p = nullptr;
+    t.map_do([&p](bnode& m) { p = &m; });
+    return p;
+  }
+  bool leaf() { return !child[0]; }
+  bool full() { return n==MaxItems; }
+
+  // position of the first item not less than x
+  template<class K>
+  int lower(const K& x, const Cmp& cmp) {
+    int i = 0;
+    while (i<n && cmp(x,items[i])>0) i++;
+    return i;
+  }
+
+  // splits the full child i into two nodes, moving its median item up
+  // into this node, which must not be full
+  void split_child(int i, Pool& pool) {
+    bnode* y = node_of(child[i]);
+    optbnode zp = pool.template make<bnode>();
+    bnode* z = node_of(zp);
+    const int t = MinDegree;
+    for(int j=0;j<t-1;j++) z->items[j] = move(y->items[j+t]);
+    if (!y->leaf())
+      for(int j=0;j<t;j++) z->child[j] = move(y->child[j+t]);
+    z->n = t-1;
+    y->n = t-1;
+    for(int j=n;j>i;j--) child[j+1] = move(child[j]);
+    child[i+1] = move(zp);
+    for(int j=n-1;j>=i;j--) items[j+1] = move(items[j]);
+    items[i] = move(y->items[t-1]);
+    n++;
+  }//split_child
+
+public:
+  BNode() : n{0} {}
+
+  // inserts into the subtree rooted at this node, which must not be full
+  bool insert_nonfull(const T& x, Pool& pool, const Cmp& cmp) {
+    bnode* cur = this;
+    while (true) {
+      int i = cur->lower(x,cmp);
+      if (i<cur->n && cmp(x,cur->items[i])==0) return false;
+      if (cur->leaf()) {
+        for(int j=cur->n-1;j>=i;j--) cur->items[j+1] = move(cur->items[j]);
+        cur->items[i] = x;
+        cur->n++;
+        return true;
+      }
+      if (node_of(cur->child[i])->full()) {
+        cur->split_child(i,pool);
+        int c = cmp(x,cur->items[i]);
+        if (c==0) return false;
+        if (c>0) i++;
+      }
+      cur = node_of(cur->child[i]);
+    }
+  }//insert_nonfull
+
+  // inserts x into the tree rooted at t; the root splits when full
+  static bool insert(optbnode& t, const T& x, Pool& pool, const Cmp& cmp) {
+    if (!t) {
+      t = pool.template make<bnode>();
+      node_of(t)->items[0] = x;
+      node_of(t)->n = 1;
+      return true;
+    }
+    if (node_of(t)->full()) {
+      optbnode s = pool.template make<bnode>();
+      node_of(s)->child[0] = move(t);
+      node_of(s)->split_child(0,pool);
+      t = move(s);
+    }
+    return node_of(t)->insert_nonfull(x,pool,cmp);
+  }//insert
+
+  template<class K>
+  static bool search(optbnode& t, const K& x, const Cmp& cmp) {
+    bnode* cur = node_of(t);
+    while (cur) {
+      int i = cur->lower(x,cmp);
+      if (i<cur->n && cmp(x,cur->items[i])==0) return true;
+      cur = node_of(cur->child[i]);
+    }
+    return false;
+  }//search
+
+  void map_inorder(function<void(T&)>& f) {
+    for(int i=0;i<n;i++) {
+      child[i].map_do([&f](bnode& c) { c.map_inorder(f); });
+      f(items[i]);
+    }
+    child[n].map_do([&f](bnode& c) { c.map_inorder(f); });
+  }
+};// BNode class
+
+template<typename T, class Cmp, int Fanout, class Pool>
+constexpr bool arena_needs_destructor<BNode<T,Cmp,Fanout,Pool>> =
+  !is_trivially_destructible<T>::value;
+
+// Same interface as BST.  Fanout 16 puts 15 doubles in two cache lines.
+template<ORDERED T, class Cmp = standard_cmp<T>, int Fanout = 16,
+         class Pool = heap_nodes>
+class BTree {
+  static_assert(Fanout>=4 && Fanout%2==0, "Fanout must be even and >= 4");
+private:
+  [[no_unique_address]] Pool pool;  // declared first: outlives the nodes
+  [[no_unique_address]] Cmp cmp;
+  optbnode root;
+  size_t count;
+public:
+  BTree() : cmp{}, root{optbnode()}, count{0} {}
+  explicit BTree(Cmp c) : cmp{move(c)}, root{optbnode()}, count{0} {}
+
+  size_t size() { return count; }
+
+  bool insert(const T& x) {
+    bool inserted = bnode::insert(root,x,pool,cmp);
+    if (inserted) count++;
+    return inserted;
+  }//insert
+
+  bool contains(const T& x) { return bnode::search(root,x,cmp); }
+  template<class K> requires transparent_cmp<Cmp>
+  bool contains(const K& x) { return bnode::search(root,x,cmp); }
+  bool contains_val(T x) { return contains(x); }
+
+  void map_inorder(function<void(T&)> f) {
+    root.map_do([&f](bnode& n){n.map_inorder(f);});
+  }
+
+  void clear() {
+    root.drop();
+    count = 0;
+    pool.release();
+  }
+
+  BTree(BTree&& other): pool{move(other.pool)}, cmp{move(other.cmp)} {
+    root = move(other.root);
+    count = other.count;
+    other.count = 0;
+  }
+  BTree& operator = (BTree&& other) {
+    root = move(other.root);
+    pool = move(other.pool);
+    cmp = move(other.cmp);
+    count = other.count;
+    other.count = 0;
+    return *this;
+  }
+}; // BTree wrapper class
+
+
+////////// Concurrent BST: lock-free reads, fine-grained locking for writers
+
+// Each node owns its children through option_ptrs, which writers change
+// only while holding the lock of that node.  A new child is published to
+// readers through an atomic pointer, after it is fully constructed, and
+// items never change once published, so readers take no locks.  Writers
+// lock only the parent of the empty link they fill (locks are striped by
+// node address), so inserts into different parts of the tree do not
+// contend.  Nodes are never removed while the tree is shared, which is
+// what makes lock-free reads safe without deferred reclamation.
+template<ORDERED T, class Cmp = standard_cmp<T>>
+class ConcurrentBST {
+private:
+  struct CNode {
+    T item;
+    atomic<CNode*> left{nullptr}, right{nullptr}; // published links
+    option_ptr<CNode> own_left, own_right;        // ownership, under lock
+    CNode(const T& x) : item{x} {}
+  };
+
+  [[no_unique_address]] Cmp cmp;
+  atomic<CNode*> root{nullptr};
+  option_ptr<CNode> own_root;
+  atomic<size_t> count{0};
+
+  static constexpr size_t Stripes = 64;
+  struct alignas(64) stripe { mutex m; };
+  stripe locks[Stripes];
+
+  mutex& lock_for(CNode* parent) {  // parent nullptr is the root link
+    return locks[(reinterpret_cast<uintptr_t>(parent)>>6) % Stripes].m;
+  }
+  static void inorder(CNode* n, function<void(T&)>& f) {
+    if (!n) return;
+    inorder(n->left.load(memory_order_acquire),f);
+    f(n->item);
+    inorder(n->right.load(memory_order_acquire),f);
+  }
+
+public:
+  ConcurrentBST() {}
+  explicit ConcurrentBST(Cmp c) : cmp{move(c)} {}
+
+  size_t size() const { return count.load(memory_order_relaxed); }
+
+  // lock-free; K is T, or any key type a transparent comparator accepts
+  template<class K = T>
+    requires same_as<K,T> || transparent_cmp<Cmp>
+  bool contains(const K& x) const {
+    CNode* n = root.load(memory_order_acquire);
+    while (n) {
+      int c = cmp(x,n->item);
+      if (c==0) return true;
+      n = (c<0 ? n->left : n->right).load(memory_order_acquire);
+    }
+    return false;
+  }
+  bool contains_val(T x) const { return contains(x); }
+
+  bool insert(const T& x) {
+    CNode* parent = nullptr;
+    atomic<CNode*>* link = &root;
+    option_ptr<CNode>* owner = &own_root;
+    while (true) {
+      CNode* n = link->load(memory_order_acquire);
+      if (!n) {
+        lock_guard<mutex> guard(lock_for(parent));
+        if (link->load(memory_order_relaxed)) continue;  // lost the race
+        *owner = Some<CNode>(x);
+        owner->map_do([&](CNode& m) { n = &m; });
+        link->store(n,memory_order_release);  // publish to readers
+        count.fetch_add(1,memory_order_relaxed);
+        return true;
+      }
+      int c = cmp(x,n->item);
+      if (c==0) return false;
+      parent = n;
+      if (c<0) { link = &n->left; owner = &n->own_left; }
+      else { link = &n->right; owner = &n->own_right; }
+    }
+  }//insert
+
+  // visits the items in order; items inserted concurrently may or may not
+  // be visited
+  void map_inorder(function<void(T&)> f) {
+    inorder(root.load(memory_order_acquire),f);
+  }
+
+  // not thread-safe: no other thread may use the tree during clear
+  void clear() {
+    root.store(nullptr);
+    own_root.drop();
+    count.store(0);
+  }
+}; // ConcurrentBST class
+
+
 /////////// arbitrary class for type-checking template Node class
 struct Arbitrary {
-  bool operator <(Arbitrary& x) { return false; }
-  bool operator >(Arbitrary& x) { return false; }  
-  bool operator ==(Arbitrary& x) { return true; }
+  bool operator <(const Arbitrary&) const { return false; }
+  bool operator >(const Arbitrary&) const { return false; }  
+  bool operator ==(const Arbitrary&) const { return true; }
   // overloads minimally satisfy requirements of ORDERED concept
 };
 
@@ -156,27 +1396,43 @@ void type_check_templates() {   // not called, just compiled
   assert(tree.contains(a1));
   assert(tree.contains_val(a1));  
   assert(tree.size()==1);
+  BST<Arbitrary,standard_cmp<Arbitrary>,arena_nodes> atree;
+  assert(atree.insert(a1));
+  assert(atree.contains(a1));
+  atree.clear();
+  BalancedBST<Arbitrary> btree;
+  assert(btree.insert(a1));
+  assert(btree.contains(a1));
+  assert(btree.erase(a1));
+  BTree<Arbitrary> bt;
+  assert(bt.insert(a1));
+  assert(bt.contains(a1));
+  ConcurrentBST<Arbitrary> ct;
+  assert(ct.insert(a1));
+  assert(ct.contains(a1));
 }//type_check_Node
 
 
-int int_reverse_cmp(int& x, int& y) { return y-x; }  // custom cmp function
-// the choice of cmp function is made at COMPILE TIME, in contrast to
-// java-ish languages.
+// custom comparator: any callable type, even a lambda's, as in
+// BST<int,decltype(int_reverse_cmp)>.  The choice of comparator type is
+// made at COMPILE TIME, in contrast to java-ish languages.
+auto int_reverse_cmp = [](int x, int y) { return y-x; };
 
 // but what if I want to decide to sort in increasing or decreasing order
-// at RUNTIME?  I can cheat with a global variable!
-bool decreasing_float = false;
-int float_cmp(double& x, double& y) {  // compares floats by rounding
-  int64_t xr = (int64_t)(x*10000000 + 0.5);
-  int64_t yr = (int64_t)(y*10000000 + 0.5);
-  if (decreasing_float) return yr-xr; else return xr-yr;
-}
-// note: won't work by creating a lambda-closure because the closure
-// can't be created at compile time.
+// at RUNTIME?  The comparator object can carry state, and each tree keeps
+// its own copy.
+struct float_cmp {  // compares floats by rounding them to multiples of 1e-7
+  bool decreasing = false;
+  int operator()(double x, double y) const {
+    long long xr = llround(x*1e7), yr = llround(y*1e7);
+    if (decreasing) swap(xr,yr);
+    return (xr > yr) - (xr < yr);
+  }
+};
 
+#ifndef BST_NO_MAIN
 int main() {
   using namespace std;
-  //decreasing_float = true; // sort in decreasing order
   BST<double,float_cmp> tree;
   for(double i:{5.0,4.0,1.5,8.0,7.2,9.1,5.9,2.5}) tree.insert(i);
   cout << tree.contains_val(7.2) << endl;
@@ -187,11 +1443,84 @@ int main() {
   tree.map_inorder([&sum](double& x){sum += x;});
   cout << "tree sum is " << sum << endl;
 
+  // bulk loading builds a balanced tree without one insert per item
+  vector<int> unsorted{42,7,19,7,88,3,56};
+  auto bulk = BST<int>::from_range(unsorted);
+  cout << "bulk-loaded tree size " << bulk.size()
+       << ", contains 19: " << bulk.contains_val(19) << endl;
+  int total = bulk.parallel_reduce([](int a, int b) { return a+b; }, 0);
+  cout << "parallel sum of bulk-loaded tree: " << total << endl;
+  FrozenBST<int> frozen = bulk.freeze();
+  cout << "frozen snapshot contains 88: " << frozen.contains_val(88)
+       << ", lower bound of 20: " << frozen.lower_bound(20) << endl;
+  stringstream saved;  // or a file: bulk.save(path), BST<int>::load(path)
+  bulk.save(saved);
+  auto reloaded = BST<int>::load(saved);
+  cout << "reloaded " << reloaded.size() << " items from "
+       << saved.str().size() << " bytes\n";
+
   BST<double,float_cmp> tree2 = move(tree);  // won't compile without move
   tree2.map_inorder([](double& x){cout << x << "  ";});
   cout << "\nsize of moved tree: " << tree.size() << endl;
+  cout << "items in [2.0,6.0):";
+  for(double& x : tree2.range(2.0,6.0)) cout << "  " << x;
+  cout << endl;
+  BST<double,float_cmp> tree3;
+  tree3.insert(tree2.extract(4.0));  // moves the node, no allocation
+  tree2.erase(5.0);
+  cout << "after moving 4 and erasing 5:";
+  for(double& x : tree2) cout << "  " << x;
+  cout << "\nmoved to tree3:";
+  for(double& x : tree3) cout << "  " << x;
+  cout << endl;
   //tree.map_inorder([](double& x){cout << x << "  ";}); // does not crash
+  BST<double,float_cmp> down(float_cmp{true});  // sort in decreasing order
+  for(double i:{5.0,4.0,1.5,8.0}) down.insert(i);
+  cout << "decreasing tree:";
+  for(double& x : down) cout << "  " << x;
+  cout << endl;
+  BST<string> names;
+  for(const char* s : {"kiwi","apple","pear"}) names.insert(s);
+  cout << "contains string_view \"pear\": "
+       << names.contains(string_view("pear")) << endl;
+
+  // nodes allocated contiguously in an arena, released all at once
+  BST<int,standard_cmp<int>,arena_nodes> atree;
+  for(int i:{50,20,80,10,30,70,90}) atree.insert(i);
+  cout << "\narena tree contains 70: " << atree.contains_val(70) << endl;
+  atree.clear();
+  cout << "arena tree size after clear: " << atree.size() << endl;
+  // a node handle owns its item, so it can outlive the arena tree it was
+  // extracted from
+  using arena_strings = BST<string,standard_cmp<string>,arena_nodes>;
+  arena_strings::node_handle plum, fig;
+  {
+    arena_strings source;
+    for(const char* s : {"fig","plum","quince"}) source.insert(s);
+    plum = source.extract("plum");
+    fig = source.extract("fig");
+  }  // source and its arena are gone
+  arena_strings target;
+  cout << "inserted handle from a destroyed arena tree: "
+       << target.insert(move(plum)) << target.contains_val("plum") << endl;
+  fig.drop();
+
+  // sorted input does not degrade a BalancedBST into a list
+  BalancedBST<int> btree;
+  for(int i=0;i<1000;i++) btree.insert(i);
+  for(int i=0;i<1000;i+=2) btree.erase_val(i);
+  cout << "balanced tree erases 1: " << btree.erase(1)  // const T&
+       << ", size " << btree.size()
+       << ", height " << btree.height() << endl;
+
+  BTree<double,float_cmp> wide;
+  for(double i:{5.0,4.0,1.5,8.0,7.2,9.1,5.9,2.5}) wide.insert(i);
+  cout << "B-tree contains 7.2: " << wide.contains_val(7.2)
+       << ", size " << wide.size() << ", items:";
+  wide.map_inorder([](double& x){cout << "  " << x;});
+  cout << endl;
 
   
   return 0;
 }//main
+#endif
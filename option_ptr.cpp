@@ -14,32 +14,398 @@
     `Nothing`.  Some is similar to make_unique.  The move semantics of
     option_ptr is similar to that of unique_ptr.
 
-    A specialization for arrays is also defined.
+    A specialization for arrays is also defined, as well as an inline
+    storage policy, option_ptr<T,inline_storage<N>>, that keeps small
+    values inside the handle instead of on the heap.  Checked access to
+    an array element returns an option_ref, a borrowed reference with the
+    same combinators that copies nothing.  Some_in creates an
+    option_ptr whose value is allocated (and later freed) through an
+    allocator or a std::pmr::memory_resource instead of new/delete.
 
     The unchecked pointer operators * and -> become available if source
     is compiled under the `g++ -D UNCHECKED_DEREF` option.
+    Compiling with `-D OPTION_PTR_STATS` counts allocations, frees and
+    calls on None, reported by option_ptr_stats() (see Instrumentation).
+
+    The combinators accept any callable (lambda, function pointer or
+    std::function) without type erasure, and deduce their result types,
+    so `a.map<int>(f)` can also be written `a.map(f)`.  Requires -std=c++17
+    (and -pthread for the parallel array operations).
 
     The included sample program `bst4.cpp` provides an implementation of
     binary search trees using option_ptr.
 
 */
 #include<functional>
+#include<type_traits>
 #include<iostream>
+#include<fstream>
 #include<string>
 #include<cstring>
+#include<cstddef>
+#include<new>
+#include<memory>
+#include<memory_resource>
+#include<vector>
+#include<thread>
+#include<atomic>
+#include<algorithm>
+#include<cstdint>
+#include<tuple>
+#if defined(__unix__) || defined(__APPLE__)
+#define OPTION_PTR_MMAP
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<fcntl.h>
+#include<unistd.h>
+#endif
 using namespace std;
 
+////////////////////////////////////////////////////////////////////////////
+///////////////// Instrumentation
+/*
+ Compiled with `-D OPTION_PTR_STATS`, option_ptr counts the allocations
+ and frees it makes, their bytes, the peak number of live allocations, and
+ for each combinator the calls that found None.  option_ptr_stats()
+ returns a snapshot of these counters.  Hooks set with
+ set_option_ptr_hooks are called on every such event, e.g. to record a
+ backtrace so the costliest callsites can be found, or to pass the events
+ on to a profiler (TracyAlloc/TracyFree).  The counters are atomic, so
+ they stay exact under the parallel array operations.  Without
+ OPTION_PTR_STATS the calls below are empty and compile away.
+*/
+enum class combinator { bind, map, map_do, match, match_do, get_or, mutate,
+                        take_or, map_move, index };  // index: A(i) on arrays
+constexpr size_t combinator_count = 10;
+
+#ifdef OPTION_PTR_STATS
+inline const char* combinator_name(combinator c) {
+  static const char* names[combinator_count] = {"bind", "map", "map_do",
+    "match", "match_do", "get_or", "mutate", "take_or", "map_move", "index"};
+  return names[size_t(c)];
+}
+
+struct option_ptr_hooks {  // null members are not called
+  void (*allocated)(const void* p, size_t bytes) = nullptr;
+  void (*freed)(const void* p, size_t bytes) = nullptr;
+  void (*none)(combinator c) = nullptr;
+};
+
+struct option_ptr_snapshot {
+  size_t allocations, frees;
+  size_t bytes_allocated, bytes_freed;
+  size_t live, peak_live;  // allocations not freed yet, now and at most
+  size_t none[combinator_count];  // calls on None, indexed by combinator
+
+  size_t none_hits(combinator c) const { return none[size_t(c)]; }
+  friend ostream& operator <<(ostream& out, const option_ptr_snapshot& s) {
+    out << "allocations " << s.allocations << " (" << s.bytes_allocated
+        << " bytes), frees " << s.frees << " (" << s.bytes_freed
+        << " bytes), live " << s.live << ", peak live " << s.peak_live
+        << "\nNone:";
+    for(size_t c=0;c<combinator_count;c++)
+      if (s.none[c]) out << " " << combinator_name(combinator(c)) << " " << s.none[c];
+    return out;
+  }
+};
+#endif
+
+// called by option_ptr on each allocation, free and None hit
+struct option_ptr_events {
+#ifdef OPTION_PTR_STATS
+  static inline atomic<size_t> allocations, frees, bytes_allocated,
+                               bytes_freed, live, peak_live;
+  static inline atomic<size_t> nones[combinator_count];
+  static inline option_ptr_hooks hooks;
+#endif
+  static void allocated([[maybe_unused]] const void* p,
+                        [[maybe_unused]] size_t bytes) {
+#ifdef OPTION_PTR_STATS
+    allocations.fetch_add(1,memory_order_relaxed);
+    bytes_allocated.fetch_add(bytes,memory_order_relaxed);
+    size_t now = live.fetch_add(1,memory_order_relaxed) + 1;
+    size_t peak = peak_live.load(memory_order_relaxed);
+    while (now>peak &&
+           !peak_live.compare_exchange_weak(peak,now,memory_order_relaxed)) {}
+    if (hooks.allocated) hooks.allocated(p,bytes);
+#endif
+  }
+  static void freed([[maybe_unused]] const void* p,
+                    [[maybe_unused]] size_t bytes) {
+#ifdef OPTION_PTR_STATS
+    frees.fetch_add(1,memory_order_relaxed);
+    bytes_freed.fetch_add(bytes,memory_order_relaxed);
+    live.fetch_sub(1,memory_order_relaxed);
+    if (hooks.freed) hooks.freed(p,bytes);
+#endif
+  }
+  static void none([[maybe_unused]] combinator c) {
+#ifdef OPTION_PTR_STATS
+    nones[size_t(c)].fetch_add(1,memory_order_relaxed);
+    if (hooks.none) hooks.none(c);
+#endif
+  }
+
+  template<class T>
+  static T* made(T* p) { allocated(p,sizeof(T)); return p; }  // new T
+  template<class P>
+  static P probe(P p, combinator c) { if (!p) none(c); return p; }
+};
+
+#ifdef OPTION_PTR_STATS
+inline option_ptr_snapshot option_ptr_stats() {
+  using E = option_ptr_events;
+  option_ptr_snapshot s;
+  s.allocations = E::allocations;
+  s.frees = E::frees;
+  s.bytes_allocated = E::bytes_allocated;
+  s.bytes_freed = E::bytes_freed;
+  s.live = E::live;
+  s.peak_live = E::peak_live;
+  for(size_t c=0;c<combinator_count;c++) s.none[c] = E::nones[c];
+  return s;
+}
+
+// clears the counters, except that live allocations stay live
+inline void option_ptr_stats_reset() {
+  using E = option_ptr_events;
+  E::allocations = E::frees = E::bytes_allocated = E::bytes_freed = 0;
+  E::peak_live = E::live.load();
+  for(size_t c=0;c<combinator_count;c++) E::nones[c] = 0;
+}
+
+inline void set_option_ptr_hooks(option_ptr_hooks h) {
+  option_ptr_events::hooks = h;
+}
+#endif
+
+
 template<typename T>
 struct pointer_deleter {
-  static void destruct(T* p) { delete p; }
+  static void destruct(T* p) {
+    option_ptr_events::freed(p,sizeof(T));
+    delete p;
+  }
 };
+
+// bytes of n items of T; like new T[n], throws bad_array_new_length if
+// that does not fit in a size_t
+template<typename T>
+size_t array_bytes(size_t n) {
+  if (n > SIZE_MAX/sizeof(T)) throw bad_array_new_length();
+  return n*sizeof(T);
+}
+
+// Storage of option_ptr<T[]>: raw memory for n items, in which the array
+// constructs and destroys its items itself, so that its capacity can
+// exceed its size.
+// rebind gives the same kind of storage for another item type.
 template<typename T>
 struct pointer_deleter<T[]> {
-  static void destruct(T* p) { delete[] p; }
+  template<class U> using rebind = pointer_deleter<U[]>;
+  static T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(array_bytes<T>(n),align_val_t(alignof(T))));
+  }
+  static void deallocate(T* p, size_t) {
+    ::operator delete(p,align_val_t(alignof(T)));
+  }
+};
+
+// array storage starting at a multiple of Align bytes, e.g. a cache line
+template<typename T, size_t Align>
+struct aligned_deleter;
+template<typename T, size_t Align>
+struct aligned_deleter<T[],Align> {
+  static_assert((Align & (Align-1))==0, "alignment must be a power of 2");
+  static constexpr size_t alignment = max(Align,alignof(T));
+  template<class U> using rebind = aligned_deleter<U[],Align>;
+  static T* allocate(size_t n) {
+    return static_cast<T*>(::operator new(array_bytes<T>(n),align_val_t(alignment)));
+  }
+  static void deallocate(T* p, size_t) {
+    ::operator delete(p,align_val_t(alignment));
+  }
+};
+
+// Array storage of 2MB or more is aligned to 2MB and marked for
+// transparent huge pages, which cuts TLB misses on large scans.  Smaller
+// arrays are just cache line aligned.
+template<typename T>
+struct huge_page_deleter;
+template<typename T>
+struct huge_page_deleter<T[]> {
+  static constexpr size_t huge_page = size_t(1)<<21;
+  template<class U> using rebind = huge_page_deleter<U[]>;
+  static size_t alignment(size_t n) {
+    return max(n*sizeof(T)>=huge_page ? huge_page : 64, alignof(T));
+  }
+  static T* allocate(size_t n) {
+    size_t bytes = array_bytes<T>(n);
+    void* p = ::operator new(bytes,align_val_t(alignment(n)));
+#if defined(OPTION_PTR_MMAP) && defined(MADV_HUGEPAGE)
+    if (bytes>=huge_page) madvise(p,bytes/huge_page*huge_page,MADV_HUGEPAGE);
+#endif
+    return static_cast<T*>(p);
+  }
+  static void deallocate(T* p, size_t n) {
+    ::operator delete(p,align_val_t(alignment(n)));
+  }
+};
+
+#ifdef OPTION_PTR_MMAP
+// Storage of arrays created by Some_mapped: the items are the pages of a
+// file mapped into memory, released with munmap.  If such an array grows
+// it moves to anonymous mapped memory, and arrays made from it by Map are
+// ordinary heap arrays.
+template<typename T>
+struct mapped_deleter;
+template<typename T>
+struct mapped_deleter<T[]> {
+  template<class U> using rebind = pointer_deleter<U[]>;
+  static T* allocate(size_t n) {
+    void* p = mmap(nullptr,max<size_t>(array_bytes<T>(n),1),PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+    if (p==MAP_FAILED) throw bad_alloc();
+    return static_cast<T*>(p);
+  }
+  static void deallocate(T* p, size_t n) {
+    // p can lie past the start of its page (after a saved array's header)
+    uintptr_t at = reinterpret_cast<uintptr_t>(p);
+    uintptr_t page = at & ~(uintptr_t(sysconf(_SC_PAGESIZE))-1);
+    munmap(reinterpret_cast<void*>(page),max<size_t>(n*sizeof(T),1)+(at-page));
+  }
+};
+
+// private_copy (the default): writes stay in this process, the file is
+//   not changed; a page is copied only when it is first written
+// read_only: the array must only be read, a write faults the process
+// shared: writes go to the file
+enum class map_mode { read_only, private_copy, shared };
+
+// opens path for mapping in mode and sets size to its size; -1 on failure
+inline int open_mappable(const string& path, map_mode mode, size_t& size) {
+  int fd = open(path.c_str(), mode==map_mode::shared ? O_RDWR : O_RDONLY);
+  struct stat st;
+  if (fd>=0 && fstat(fd,&st)!=0) { close(fd); fd = -1; }
+  size = fd>=0 ? st.st_size : 0;
+  return fd;
+}
+// maps the first bytes of the open file fd; nullptr on failure
+inline void* map_open(int fd, size_t bytes, map_mode mode) {
+  int prot = mode==map_mode::read_only ? PROT_READ : PROT_READ|PROT_WRITE;
+  int flags = mode==map_mode::shared ? MAP_SHARED : MAP_PRIVATE;
+  void* p = mmap(nullptr,bytes,prot,flags,fd,0);
+  return p==MAP_FAILED ? nullptr : p;
+}
+#endif
+
+// An array saved by write or save is this header followed by the bytes of
+// its items, in the byte order of the machine that wrote them; byte_order
+// reads differently on a machine with the other byte order, which then
+// rejects the file.
+struct array_header {
+  char magic[4] = {'O','P','T','A'};
+  uint32_t byte_order = 0x01020304;
+  uint64_t item_size = 0;
+  uint64_t count = 0;
+  uint64_t unused = 0;  // 32 bytes in all, so that the items stay aligned
+  bool valid(size_t isz) const {
+    return memcmp(magic,"OPTA",4)==0 && byte_order==0x01020304 &&
+           item_size==isz;
+  }
+};
+
+// for pointers whose memory is released by their owner
+template<typename T>
+struct no_deleter {
+  static void destruct(T*) {}
 };
 
 template<class TY, class deleter = pointer_deleter<TY>>
-class option_ptr {
+class option_ptr;
+
+// Deleter for values created by Some_in: destruction and deallocation go
+// through the allocator the value was created with.  The (rebound)
+// allocator is a base class, so a stateless allocator such as
+// std::allocator adds nothing to the size of the option_ptr.  construct
+// is static and receives the allocator, so that a specialization for an
+// arena-like allocator can choose to keep no state at all.
+template<class TY, class Alloc>
+struct alloc_deleter
+  : private allocator_traits<Alloc>::template rebind_alloc<TY> {
+  using allocator_type = typename allocator_traits<Alloc>::template rebind_alloc<TY>;
+  using traits = allocator_traits<allocator_type>;
+
+  alloc_deleter() = default;
+  alloc_deleter(const Alloc& a): allocator_type(a) {}
+
+  template<class... Args>
+  static TY* construct(const Alloc& alloc, Args&&... args) {
+    allocator_type a(alloc);
+    TY* p = traits::allocate(a,1);
+    try { traits::construct(a,p,std::forward<Args>(args)...); }
+    catch (...) { traits::deallocate(a,p,1); throw; }
+    option_ptr_events::allocated(p,sizeof(TY));
+    return p;
+  }
+  void destruct(TY* p) {
+    allocator_type& a = *this;
+    traits::destroy(a,p);
+    option_ptr_events::freed(p,sizeof(TY));
+    traits::deallocate(a,p,1);
+  }
+};
+
+// Values allocated from a std::pmr::memory_resource only record the
+// resource pointer (pmr::polymorphic_allocator is not assignable).
+template<class TY>
+struct alloc_deleter<TY,pmr::memory_resource*> {
+  pmr::memory_resource* resource = nullptr;
+
+  alloc_deleter() = default;
+  alloc_deleter(pmr::memory_resource* r): resource{r} {}
+
+  template<class... Args>
+  static TY* construct(pmr::memory_resource* resource, Args&&... args) {
+    void* p = resource->allocate(sizeof(TY),alignof(TY));
+    try { return option_ptr_events::made(new(p) TY(std::forward<Args>(args)...)); }
+    catch (...) { resource->deallocate(p,sizeof(TY),alignof(TY)); throw; }
+  }
+  void destruct(TY* p) {
+    p->~TY();
+    option_ptr_events::freed(p,sizeof(TY));
+    resource->deallocate(p,sizeof(TY),alignof(TY));
+  }
+};
+
+// Result type of a combinator: the explicitly given TU, or if TU is
+// omitted (void), the type returned by calling F on Args.
+template<class TU, class F, class... Args>
+struct combinator_result { using type = TU; };
+template<class F, class... Args>
+struct combinator_result<void,F,Args...> {
+  using type = decay_t<invoke_result_t<F,Args...>>;
+};
+template<class TU, class F, class... Args>
+using combinator_result_t = typename combinator_result<TU,F,Args...>::type;
+
+// bind<TU>(f) returns option_ptr<TU>; bind(f) returns whatever f returns
+template<class TU, class F, class... Args>
+using bind_result_t =
+  combinator_result_t<conditional_t<is_void<TU>::value,void,option_ptr<TU>>,
+                      F,Args...>;
+
+// the value type of an option_ptr type, e.g. int for option_ptr<int>
+template<class O> struct option_value;
+template<class TY, class D> struct option_value<option_ptr<TY,D>> {
+  using type = TY;
+};
+
+// The deleter is a private base so that stateless deleters such as
+// pointer_deleter take no space (empty base optimization), while a
+// stateful deleter, e.g. one holding an allocator, travels with the pointer.
+template<class TY, class deleter>
+class option_ptr : private deleter {
 protected:
   TY* ptr; // internal pointer to something of type TY
 
@@ -49,6 +415,7 @@ protected:
   }
 private:
   option_ptr(TY* p) {ptr=p;}  // private constructors discourage raw pointers
+  option_ptr(TY* p, deleter&& d): deleter(move(d)), ptr{p} {}
   
 public:
   constexpr option_ptr(): ptr{nullptr} {}  // null is only used internally
@@ -56,14 +423,18 @@ public:
   void drop() { if (ptr) deleter::destruct(ptr);  ptr=nullptr; } 
   operator bool() const { return ptr!=nullptr; } // overload bool operator
 
-  //template<class TU,class deleter2>
-  //friend class option_ptr<TU[],deleter2>;
+  template<class TU,class deleter2>
+  friend class option_ptr;  // so that map can build option_ptr<TU>
   
   // friend functions that are part of API
   template<class TU, class... Args>
   friend option_ptr<TU> Some(Args&&... args);
   template<class TU>
   friend option_ptr<TU> Nothing();
+  template<class TU, class Alloc, class... Args>
+  friend option_ptr<TU,alloc_deleter<TU,Alloc>>
+  Some_in(const Alloc& alloc, Args&&... args);
+  friend struct option_access;  // for map_n, bind_n and zip
   friend ostream& operator <<(ostream& out, option_ptr&& r) {
     if (r.ptr) { out << "Some(" << *r.ptr << ")"; }
     else { out << "None"; }
@@ -80,70 +451,80 @@ public:
 
   /////////////// Move Semantics:
 
-  option_ptr<TY>& operator=(option_ptr<TY>&& other) { 
+  option_ptr& operator=(option_ptr&& other) { 
+    if (this == &other) return *this;
     if (ptr) deleter::destruct(ptr); // prevent memory leaks before assignment
+    static_cast<deleter&>(*this) = move(static_cast<deleter&>(other));
     ptr = other.ptr;  // takes over "ownership" of heap value
     other.ptr = nullptr; // ownership is unqiue
     return *this;
   }// move assignment operator
 
-  option_ptr(option_ptr<TY>&& other) {
-    if (ptr) deleter::destruct(ptr);
+  option_ptr(option_ptr&& other): deleter(move(static_cast<deleter&>(other))) {
     ptr = other.ptr;    
     other.ptr = nullptr;
   }// move constructor
 
 
   ///////////////// Monadic operations without move:
-  
-  template<class TU>
-  option_ptr<TU> bind(function<option_ptr<TU>(TY&)> f) {
-    if (ptr) return f(*ptr);
-    else return option_ptr<TU>();
+
+  // The combinators take their function arguments as deduced template
+  // parameters instead of std::function, so lambdas are called directly
+  // and can be inlined.  The explicit type argument (e.g. map<int>) is
+  // optional: when omitted the result type is deduced from the function.
+
+  template<class TU=void, class F>
+  auto bind(F&& f) -> bind_result_t<TU,F,TY&> {
+    if (option_ptr_events::probe(ptr,combinator::bind)) return f(*ptr);
+    else return bind_result_t<TU,F,TY&>();
     //else return move(*(option_ptr<TU>*)this); // not a good idea
   }//bind
 
-  template<class TU>
-  option_ptr<TU> map(function<TU(TY&)> f) {
-    if (ptr) {
-      TU result = f(*ptr);
-      TU* pr = new TU(result);
-      return option_ptr<TU>(pr);
-    }
-    else return option_ptr<TU>();
+  template<class TU=void, class F>
+  auto map(F&& f) -> option_ptr<combinator_result_t<TU,F,TY&>> {
+    using TR = combinator_result_t<TU,F,TY&>;
+    if (option_ptr_events::probe(ptr,combinator::map))  // constructed in place
+      return option_ptr<TR>(option_ptr_events::made(new TR(f(*ptr))));
+    else return option_ptr<TR>();
   }// a.map(f) == a.bind([&](auto x){return Some(f(x));})
 
-  void map_do(function<void(TY&)> f) {
-    if (ptr) f(*ptr);
+  template<class F>
+  void map_do(F&& f) {
+    if (option_ptr_events::probe(ptr,combinator::map_do)) f(*ptr);
   }
 
-  template<typename TU>
-  TU match(function<TU(TY&)> somefun, function<TU()> nonefun) {
-    if (ptr) return somefun(*ptr); else return nonefun();
+  template<class TU=void, class FS, class FN>
+  auto match(FS&& somefun, FN&& nonefun) -> combinator_result_t<TU,FS,TY&> {
+    if (option_ptr_events::probe(ptr,combinator::match)) return somefun(*ptr);
+    else return nonefun();
   }//match
 
   // explicit template instantiation - only in namespace scope
   //template  <> bool match<bool>(function<bool(TY&)>, function<bool()>);
   
-  void match_do(function<void(TY&)> some, function<void()> none) {
-    if (ptr) some(*ptr); else none();
+  template<class FS, class FN>
+  void match_do(FS&& some, FN&& none) {
+    if (option_ptr_events::probe(ptr,combinator::match_do)) some(*ptr);
+    else none();
   }//match do
 
   // get_or does not move, returns reference
   TY& get_or(TY& default_val) {
-    if (ptr) return *ptr; else return default_val;
+    if (option_ptr_events::probe(ptr,combinator::get_or)) return *ptr;
+    else return default_val;
   }
 
   // map with function returning same type
-  option_ptr<TY>& mutate(function<TY(TY&)> f) {
-    if (ptr) { *ptr = f(*ptr); }
+  template<class F>
+  option_ptr& mutate(F&& f) {
+    if (option_ptr_events::probe(ptr,combinator::mutate)) { *ptr = f(*ptr); }
     return *this;
   }//map
 
   ////////////// Monadic operations with move:
 
   TY take_or(TY default_val) {
-    if (ptr) {
+    if (option_ptr_events::probe(ptr,combinator::take_or)) {
       TY x = move(*ptr);
       deleter::destruct(ptr);
       ptr = nullptr;
@@ -152,17 +533,29 @@ public:
     else return default_val;
   }//take
 
-  // map_move moves value into new option_ptr
-  template<class TU>
-  option_ptr<TU> map_move(function<TU(TY)> f) {
-    if (ptr) {
-      TU result = f(*ptr);
-      TU* pr = new TU(result);
+  // map_move moves value into new option_ptr.  When the result has the
+  // same type, the existing heap slot is reused instead of reallocated.
+  // (map and map_move always allocate results with new, also for an
+  // option_ptr created by Some_in; use bind with Some_in to stay in an arena)
+  template<class TU=void, class F>
+  auto map_move(F&& f) -> option_ptr<combinator_result_t<TU,F,TY&&>> {
+    using TR = combinator_result_t<TU,F,TY&&>;
+    if (!option_ptr_events::probe(ptr,combinator::map_move))
+      return option_ptr<TR>();
+    if constexpr (is_same<option_ptr<TR>,option_ptr>::value &&
+                  is_move_assignable<TY>::value) {
+      TR r = f(move(*ptr));  // first, in case f returns *ptr itself as TY&&
+      *ptr = move(r);
+      option_ptr<TR> R(ptr);
+      ptr = nullptr;
+      return R;
+    }
+    else {
+      TR* pr = option_ptr_events::made(new TR(f(move(*ptr))));
       deleter::destruct(ptr);
       ptr = nullptr;
-      return option_ptr<TU>(pr);
+      return option_ptr<TR>(pr);
     }
-    else return option_ptr<TU>();
   }//map_move
 
 #ifdef UNCHECKED_DEREF
@@ -184,7 +577,7 @@ public:
 // Some:  (monadic unit), works like make_unique
 template<class TY, class... Args>
 option_ptr<TY> Some(Args&&... args) {
-  return option_ptr<TY>(new TY(std::forward<Args>(args)...));
+  return option_ptr<TY>(option_ptr_events::made(new TY(std::forward<Args>(args)...)));
   // forward retains original l/r-value status of args
 }// Some
 
@@ -196,6 +589,359 @@ option_ptr<TY> Nothing() {
 template<class TY>
 constexpr option_ptr<TY> None = move(option_ptr<TY>());
 
+// Some_in:  like Some, but allocates through an allocator, e.g.
+// Some_in<T>(std::allocator<T>(), args...), and releases the value through
+// the same allocator when the option_ptr is dropped.
+template<class TY, class Alloc, class... Args>
+option_ptr<TY,alloc_deleter<TY,Alloc>> Some_in(const Alloc& alloc, Args&&... args) {
+  TY* p = alloc_deleter<TY,Alloc>::construct(alloc,std::forward<Args>(args)...);
+  return option_ptr<TY,alloc_deleter<TY,Alloc>>(p,alloc_deleter<TY,Alloc>(alloc));
+}// Some_in
+
+// Some_in with a memory resource, e.g. a per-request
+// std::pmr::monotonic_buffer_resource: Some_in<T>(&arena, args...)
+template<class TY, class R, class... Args>
+option_ptr<TY,alloc_deleter<TY,pmr::memory_resource*>>
+Some_in(R* resource, Args&&... args) {
+  return Some_in<TY,pmr::memory_resource*>(resource,std::forward<Args>(args)...);
+}
+
+template<class TY>
+using pmr_option_ptr = option_ptr<TY,alloc_deleter<TY,pmr::memory_resource*>>;
+
+
+///////////////// Combinators over several option_ptrs
+// Each operand is checked once and f is called directly on all the values,
+// instead of nesting one bind per operand, and only the result allocates.
+
+struct option_access {
+  template<class TY, class D>
+  static TY* get(option_ptr<TY,D>& p) { return p.ptr; }
+  template<class TY>
+  static TY* release(option_ptr<TY>& p) {  // p gives up its value
+    TY* q = p.ptr;
+    p.ptr = nullptr;
+    return q;
+  }
+  template<class TY>
+  static option_ptr<TY> adopt(TY* p) { return option_ptr<TY>(p); }
+  template<class TR, class G>
+  static option_ptr<TR> make_from(G&& g) {  // constructs g() in place
+    return option_ptr<TR>(option_ptr_events::made(new TR(g())));
+  }
+};
+
+template<size_t N> struct inline_storage;
+
+// whether get reaches the value of an O: an option_ptr holding its value
+// through a pointer, not an array or an option_box, whose value is inline
+template<class O> struct is_pointer_option : false_type {};
+template<class TY, class D>
+struct is_pointer_option<option_ptr<TY,D>> : bool_constant<!is_array<TY>::value> {};
+template<class TY, size_t N>
+struct is_pointer_option<option_ptr<TY,inline_storage<N>>> : false_type {};
+
+template<class O>
+using option_value_t = typename option_value<decay_t<O>>::type;
+
+// The operands may be lvalues or temporaries, e.g. map_n(f,parseint(a),
+// parseint(b)); the values are passed to f by reference in either case.
+
+// map_n(f,a,b,...) is Some(f(x,y,...)) if a,b,... hold x,y,..., else None
+template<class F, class... O>
+auto map_n(F&& f, O&&... args)
+  -> option_ptr<decay_t<invoke_result_t<F,option_value_t<O>&...>>> {
+  static_assert((is_pointer_option<remove_reference_t<O>>::value && ...),
+                "map_n requires non-const, non-array heap option_ptrs");
+  using TR = decay_t<invoke_result_t<F,option_value_t<O>&...>>;
+  if (!(option_access::get(args) && ...)) return Nothing<TR>();
+  return option_access::make_from<TR>([&]() -> TR {
+    return f(*option_access::get(args)...);
+  });
+}//map_n
+
+// bind_n(f,a,b,...) is f(x,y,...), itself an option_ptr, if a,b,... hold
+// x,y,..., else None
+template<class F, class... O>
+auto bind_n(F&& f, O&&... args)
+  -> decay_t<invoke_result_t<F,option_value_t<O>&...>> {
+  static_assert((is_pointer_option<remove_reference_t<O>>::value && ...),
+                "bind_n requires non-const, non-array heap option_ptrs");
+  if (!(option_access::get(args) && ...))
+    return decay_t<invoke_result_t<F,option_value_t<O>&...>>();
+  return f(*option_access::get(args)...);
+}//bind_n
+
+// zip(a,b,...) is Some of a tuple of copies of the values, if all are Some
+template<class... O>
+option_ptr<tuple<option_value_t<O>...>> zip(O&&... args) {
+  static_assert((is_pointer_option<remove_reference_t<O>>::value && ...),
+                "zip requires non-const, non-array heap option_ptrs");
+  return map_n([](option_value_t<O>&... x) {
+                 return tuple<option_value_t<O>...>(x...);
+               }, args...);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////
+///////////////// Inline storage policy
+/*
+ option_ptr<TY,inline_storage<N>> keeps a value of up to N bytes inside
+ the handle itself, next to an engaged flag, so that small values such as
+ the int and double results of parseint and safediv do not go to the heap.
+ Values that are too large (or over-aligned) fall back to a heap pointer.
+ The interface is the same move-only, combinator-only one as the heap
+ version; Some_inline plays the role of Some.  Moving an inline value
+ moves the value itself rather than a pointer.
+*/
+
+template<size_t N>
+struct inline_storage { static constexpr size_t capacity = N; };
+
+template<class TY, bool in_place>
+struct inline_slot;  // storage of option_ptr<TY,inline_storage<N>>
+
+template<class TY>
+struct inline_slot<TY,true> {  // value lives inside the handle
+  alignas(TY) unsigned char buf[sizeof(TY)];
+  bool engaged = false;
+
+  TY* get() { return engaged ? launder(reinterpret_cast<TY*>(buf)) : nullptr; }
+  bool has_value() const { return engaged; }
+  template<class... Args>
+  void emplace(Args&&... args) {
+    new(buf) TY(std::forward<Args>(args)...);
+    engaged = true;
+  }
+  template<class G>
+  void emplace_from(G&& g) { new(buf) TY(g()); engaged = true; } // elides
+  void reset() { if (engaged) { get()->~TY(); engaged = false; } }
+  void take(inline_slot& other) {  // other's value moves into this empty slot
+    if (other.engaged) { emplace(move(*other.get())); other.reset(); }
+  }
+};
+
+template<class TY>
+struct inline_slot<TY,false> {  // too large, value lives on the heap
+  TY* ptr = nullptr;
+
+  TY* get() { return ptr; }
+  bool has_value() const { return ptr!=nullptr; }
+  template<class... Args>
+  void emplace(Args&&... args) {
+    ptr = option_ptr_events::made(new TY(std::forward<Args>(args)...));
+  }
+  template<class G>
+  void emplace_from(G&& g) { ptr = option_ptr_events::made(new TY(g())); }
+  void reset() {
+    if (ptr) { option_ptr_events::freed(ptr,sizeof(TY)); delete ptr; ptr = nullptr; }
+  }
+  void take(inline_slot& other) { ptr = other.ptr; other.ptr = nullptr; }
+};
+
+template<class TY, size_t N>
+class option_ptr<TY,inline_storage<N>> {
+private:
+  static constexpr bool in_place =
+    sizeof(TY) <= N && alignof(TY) <= alignof(max_align_t);
+  inline_slot<TY,in_place> slot;
+  // the value, or nullptr (a None hit of combinator c)
+  TY* value(combinator c) { return option_ptr_events::probe(slot.get(),c); }
+
+public:
+  option_ptr() {}  // None
+  ~option_ptr() { slot.reset(); }
+  void drop() { slot.reset(); }
+  operator bool() const { return slot.has_value(); }
+  static constexpr bool stored_inline() { return in_place; }
+
+  template<class TU,class deleter2>
+  friend class option_ptr;
+  template<class TU, size_t M, class... Args>
+  friend option_ptr<TU,inline_storage<M>> Some_inline(Args&&... args);
+  friend ostream& operator <<(ostream& out, option_ptr&& r) {
+    if (r) { out << "Some(" << *r.slot.get() << ")"; }
+    else { out << "None"; }
+    return out;
+  }
+  friend ostream& operator <<(ostream& out, option_ptr& r)  {
+    out << move(r);
+    return out;
+  }
+
+  /////////////// Move Semantics:
+
+  option_ptr& operator=(option_ptr&& other) {
+    if (this != &other) { slot.reset(); slot.take(other.slot); }
+    return *this;
+  }// move assignment operator
+
+  option_ptr(option_ptr&& other) { slot.take(other.slot); } // move constructor
+
+  ///////////////// Monadic operations, as for the heap version:
+
+  template<class TU=void, class F>
+  auto bind(F&& f) -> bind_result_t<TU,F,TY&> {
+    if (TY* p = value(combinator::bind)) return f(*p);
+    else return bind_result_t<TU,F,TY&>();
+  }//bind
+
+  // the result keeps the same storage policy
+  template<class TU=void, class F>
+  auto map(F&& f) -> option_ptr<combinator_result_t<TU,F,TY&>,inline_storage<N>>
+  {
+    using TR = combinator_result_t<TU,F,TY&>;
+    option_ptr<TR,inline_storage<N>> R;
+    if (TY* p = value(combinator::map))
+      R.slot.emplace_from([&]() -> TR { return f(*p); });
+    return R;
+  }//map
+
+  template<class F>
+  void map_do(F&& f) {
+    if (TY* p = value(combinator::map_do)) f(*p);
+  }
+
+  template<class TU=void, class FS, class FN>
+  auto match(FS&& somefun, FN&& nonefun) -> combinator_result_t<TU,FS,TY&> {
+    if (TY* p = value(combinator::match)) return somefun(*p);
+    else return nonefun();
+  }//match
+
+  template<class FS, class FN>
+  void match_do(FS&& some, FN&& none) {
+    if (TY* p = value(combinator::match_do)) some(*p); else none();
+  }//match do
+
+  TY& get_or(TY& default_val) {
+    if (TY* p = value(combinator::get_or)) return *p; else return default_val;
+  }
+
+  template<class F>
+  option_ptr& mutate(F&& f) {
+    if (TY* p = value(combinator::mutate)) { *p = f(*p); }
+    return *this;
+  }//mutate
+
+  TY take_or(TY default_val) {
+    if (TY* p = value(combinator::take_or)) {
+      TY x = move(*p);
+      slot.reset();
+      return x;
+    }
+    else return default_val;
+  }//take
+
+  template<class TU=void, class F>
+  auto map_move(F&& f)
+    -> option_ptr<combinator_result_t<TU,F,TY&&>,inline_storage<N>> {
+    using TR = combinator_result_t<TU,F,TY&&>;
+    option_ptr<TR,inline_storage<N>> R;
+    if (TY* p = value(combinator::map_move)) {
+      R.slot.emplace_from([&]() -> TR { return f(move(*p)); });
+      slot.reset();
+    }
+    return R;
+  }//map_move
+
+#ifdef UNCHECKED_DEREF
+  TY& operator *() { return *slot.get(); }
+  TY* operator ->() { return slot.get(); }
+#endif
+
+}; // option_ptr<TY,inline_storage<N>>
+
+// Some_inline<int>(3) stores the int inside the handle; N defaults to
+// sizeof(TY), so the value is always stored inline unless over-aligned
+template<class TY, size_t N = sizeof(TY), class... Args>
+option_ptr<TY,inline_storage<N>> Some_inline(Args&&... args) {
+  option_ptr<TY,inline_storage<N>> R;
+  R.slot.emplace(std::forward<Args>(args)...);
+  return R;
+}// Some_inline
+
+template<class TY>
+using option_box = option_ptr<TY,inline_storage<sizeof(TY)>>;
+
+
+
+////////////////////////////////////////////////////////////////////////////
+///////////////// Borrowed references
+/*
+ option_ref<TY> is a non-owning, possibly empty reference to a value owned
+ by something else, such as an element of an option_ptr<TY[]>.  It offers
+ the same combinators as option_ptr, without any allocation: the value is
+ neither copied nor moved, and changes made through it (map_do, mutate)
+ are seen by the owner.  Like any reference it must not outlive its owner.
+ It is copyable, since it owns nothing.
+*/
+
+template<class TY>
+class option_ref {
+private:
+  TY* ptr;
+  // ptr, or nullptr (a None hit of combinator c)
+  TY* value(combinator c) const { return option_ptr_events::probe(ptr,c); }
+  // private like option_ptr's: only the owner of the value can lend it
+  constexpr explicit option_ref(TY* p): ptr{p} {}
+  template<class TU, class deleter>
+  friend class option_ptr;  // arrays lend their items
+public:
+  constexpr option_ref(): ptr{nullptr} {}  // None
+  operator bool() const { return ptr!=nullptr; }
+
+  friend ostream& operator <<(ostream& out, option_ref r) {
+    if (r.ptr) { out << "Some(" << *r.ptr << ")"; }
+    else { out << "None"; }
+    return out;
+  }
+
+  template<class TU=void, class F>
+  auto bind(F&& f) const -> bind_result_t<TU,F,TY&> {
+    if (value(combinator::bind)) return f(*ptr);
+    else return bind_result_t<TU,F,TY&>();
+  }//bind
+
+  // the result is a new, owning option_ptr
+  template<class TU=void, class F>
+  auto map(F&& f) const -> option_ptr<combinator_result_t<TU,F,TY&>> {
+    using TR = combinator_result_t<TU,F,TY&>;
+    if (value(combinator::map)) return Some<TR>(f(*ptr));
+    else return Nothing<TR>();
+  }//map
+
+  template<class F>
+  void map_do(F&& f) const {
+    if (value(combinator::map_do)) f(*ptr);
+  }
+
+  template<class TU=void, class FS, class FN>
+  auto match(FS&& somefun, FN&& nonefun) const -> combinator_result_t<TU,FS,TY&> {
+    if (value(combinator::match)) return somefun(*ptr); else return nonefun();
+  }//match
+
+  template<class FS, class FN>
+  void match_do(FS&& some, FN&& none) const {
+    if (value(combinator::match_do)) some(*ptr); else none();
+  }//match do
+
+  TY& get_or(TY& default_val) const {
+    if (value(combinator::get_or)) return *ptr; else return default_val;
+  }
+
+  template<class F>
+  const option_ref& mutate(F&& f) const {
+    if (value(combinator::mutate)) { *ptr = f(*ptr); }
+    return *this;
+  }//mutate
+
+#ifdef UNCHECKED_DEREF
+  TY& operator *() const { return *ptr; }
+  TY* operator ->() const { return ptr; }
+#endif
+}; // option_ref class
+
 
 
 ////////////////////////////////////////////////////////////////////////////
@@ -206,73 +952,514 @@ constexpr option_ptr<TY> None = move(option_ptr<TY>());
  with its own operations including map/reduce.  However, the [i] operator
  is overloaded in the same way, with no runtime overhead to check for
  the validity of i, and so it can be used unsafely.
+
+ Like a vector, the array holds size() items in storage for capacity()
+ items, and can grow; the storage policy (by default pointer_deleter<T[]>)
+ allocates raw memory, and items are constructed in it only when needed:
+ Map constructs its results in place instead of assigning over default
+ constructed items.
+
+ The loops of foreach, Map and reduce call their function directly, so
+ they can be inlined and vectorized.  Called with a `parallel` tag first,
+ e.g. A.Map(parallel{}, f), they split the array into one contiguous
+ chunk per thread.
 */
 
+// Execution tag of the parallel array operations.  threads = 0 uses one
+// thread per core; arrays shorter than grain elements per thread use
+// fewer threads (down to just the calling one).
+struct parallel {
+  unsigned threads = 0;
+  size_t grain = 1<<15;
+};
+
+inline unsigned parallel_chunks(parallel p, size_t n) {
+  unsigned t = p.threads ? p.threads : max(1u,thread::hardware_concurrency());
+  size_t most = max<size_t>(1,n/max<size_t>(1,p.grain));
+  return (unsigned)min<size_t>(t,most);
+}
+
+// runs task(c,begin,end) on chunk c = 0..chunks-1 of [0,n), each on its
+// own thread (chunk 0 on the calling one)
+template<class F>
+void run_chunks(unsigned chunks, size_t n, F&& task) {
+  vector<thread> workers;
+  for(unsigned c=1;c<chunks;c++)
+    workers.emplace_back([&task,c,chunks,n]() {
+      task(c,n*c/chunks,n*(c+1)/chunks);
+    });
+  task(0u,(size_t)0,n/chunks);
+  for(thread& w : workers) w.join();
+}
+
+template<class T, class Gen>
+class lazy_pipe;
+
+template<class TY, class deleter = pointer_deleter<TY[]>>
+option_ptr<TY[],deleter> Some_array(size_t n);
+template<class TY, class deleter = pointer_deleter<TY[]>>
+option_ptr<TY[],deleter> Some_array_uninit(size_t n);
+template<class TY, class deleter = pointer_deleter<TY[]>>
+option_ptr<TY[],deleter> Some_read(istream& in);
+#ifdef OPTION_PTR_MMAP
+template<class TY>
+option_ptr<TY[],mapped_deleter<TY[]>>
+Some_mapped(const string& path, map_mode mode = map_mode::private_copy);
+template<class TY>
+option_ptr<TY[],mapped_deleter<TY[]>>
+Some_mapped_saved(const string& path, map_mode mode = map_mode::private_copy);
+#endif
+
 template<class TY,class deleter>
-class option_ptr<TY[],deleter> : public option_ptr<TY,pointer_deleter<TY[]>>
+class option_ptr<TY[],deleter> : public option_ptr<TY,no_deleter<TY>>
 {
 private:
-  unsigned int len;
-  option_ptr(unsigned int n): len{n} { this->ptr = new TY[n]; }
+  size_t len;  // items [0,len) are constructed
+  size_t cap;  // room for cap items
+  // the storage policy, noting the events for OPTION_PTR_STATS
+  static TY* allocate(size_t n) {
+    TY* p = deleter::allocate(n);
+    option_ptr_events::allocated(p,n*sizeof(TY));
+    return p;
+  }
+  static void deallocate(TY* p, size_t n) {
+    option_ptr_events::freed(p,n*sizeof(TY));
+    deleter::deallocate(p,n);
+  }
+  // storage for c items, of which none is constructed yet
+  static option_ptr with_capacity(size_t c) {
+    option_ptr R;
+    R.ptr = allocate(c);
+    R.cap = c;
+    return R;
+  }
+  option_ptr(size_t n): option_ptr() {  // n default constructed items
+    this->ptr = allocate(n);
+    cap = n;
+    uninitialized_default_construct_n(this->ptr,n);  // freed if this throws
+    len = n;
+  }
+
+  void release() {
+    if (!this->ptr) return;
+    destroy_n(this->ptr,len);
+    deallocate(this->ptr,cap);
+    this->ptr = nullptr;
+    len = cap = 0;
+  }
+
+  // constructs r[i] = g(i) in raw memory for i in [b,e), destroying the
+  // new items (and rethrowing) if g throws
+  template<class TU, class G>
+  static void construct_range(TU* r, size_t b, size_t e, G&& g) {
+    size_t i = b;
+    try { for(; i<e; i++) new(r+i) TU(g(i)); }
+    catch (...) { destroy(r+b,r+i); throw; }
+  }
+
+  // f(acc,x) over items [b,e), starting from acc
+  template<class U, class F>
+  U fold_range(F& f, U acc, size_t b, size_t e) {
+    TY* a = this->ptr;
+    for(size_t i=b;i<e;i++) acc = f(acc,a[i]);
+    return acc;
+  }
 public:
-  option_ptr(): len{0} { this->ptr = nullptr; }
-  //~option_ptr() { if (this->ptr) delete[] this->ptr; }
+  option_ptr(): len{0}, cap{0} { this->ptr = nullptr; }
+  ~option_ptr() { release(); }
+  void drop() { release(); }
+
+  template<class TU,class deleter2>
+  friend class option_ptr;  // so that Map can build option_ptr<TU[]>
   
+  template<class TU, class deleter2>
+  friend option_ptr<TU[],deleter2> Some_array(size_t n);
+  template<class TU, class deleter2>
+  friend option_ptr<TU[],deleter2> Some_array_uninit(size_t n);
+  template<class TU, class deleter2>
+  friend option_ptr<TU[],deleter2> Some_read(istream& in);
+#ifdef OPTION_PTR_MMAP
+  template<class TU>
+  friend option_ptr<TU[],mapped_deleter<TU[]>>
+  Some_mapped(const string& path, map_mode mode);
   template<class TU>
-  friend option_ptr<TU[]> Some_array(unsigned int n);
+  friend option_ptr<TU[],mapped_deleter<TU[]>>
+  Some_mapped_saved(const string& path, map_mode mode);
+#endif
+
+  // array of TU with the same kind of storage, e.g. the result of Map
+  template<class TU>
+  using array_of = option_ptr<TU[],typename deleter::template rebind<TU>>;
+
+  // take_or and map_move would give away the storage as a single value
+  TY take_or(TY) = delete;
+  template<class TU=void, class F> void map_move(F&&) = delete;
+  // the other scalar combinators would act on item 0 alone, and on raw
+  // memory when the array is empty; use A(i) for one item, or Map,
+  // foreach, reduce etc. for all of them
+  template<class TU=void, class F> void bind(F&&) = delete;
+  template<class TU=void, class F> void map(F&&) = delete;
+  template<class F> void map_do(F&&) = delete;
+  template<class TU=void, class FS, class FN> void match(FS&&, FN&&) = delete;
+  template<class FS, class FN> void match_do(FS&&, FN&&) = delete;
+  TY& get_or(TY&) = delete;
+  template<class F> void mutate(F&&) = delete;
+  friend ostream& operator <<(ostream&, option_ptr&&) = delete;
+  friend ostream& operator <<(ostream&, option_ptr&) = delete;
+
+  // None if there is no item, also for an empty array with capacity
+  operator bool() const { return len>0; }
   
-  TY& operator [] (unsigned int i) { return this->ptr[i]; } // unchecked
-
-  option_ptr<TY> operator() (unsigned int i) { // checked
-    if (this->ptr && (i<len)) return Some<TY>(this->ptr[i]);  //copy!
-    // option_ptr<TY> R;
-    //  this->connect(R,this->ptr+i);
-    //  return R;
-    //}
-    return Nothing<TY>();
-}
+  TY& operator [] (size_t i) { return this->ptr[i]; } // unchecked
+  const TY& operator [] (size_t i) const { return this->ptr[i]; }
+
+  // checked access: a borrowed reference to element i, or None if i is
+  // out of bounds; costs one bounds check, no copy and no allocation
+  option_ref<TY> operator() (size_t i) {
+    if (this->ptr && (i<len)) return option_ref<TY>(this->ptr+i);
+    option_ptr_events::none(combinator::index);
+    return option_ref<TY>();
+  }
+  option_ref<const TY> operator() (size_t i) const {
+    if (this->ptr && (i<len)) return option_ref<const TY>(this->ptr+i);
+    option_ptr_events::none(combinator::index);
+    return option_ref<const TY>();
+  }
 
-  unsigned int size() { return len; }
+  size_t size() const { return len; }
+  size_t capacity() const { return cap; }
+
+  ////// growth, as for vector: moves the items to larger storage when full
+
+  // makes room for n items, without changing size()
+  void reserve(size_t n) {
+    if (n<=cap) return;
+    TY* p = allocate(n);
+    if (this->ptr) {
+      uninitialized_move_n(this->ptr,len,p);
+      destroy_n(this->ptr,len);
+      deallocate(this->ptr,cap);
+    }
+    this->ptr = p;
+    cap = n;
+  }
+
+  // appends x, in amortized O(1) time
+  void push_back(TY x) {
+    if (len==cap) reserve(cap ? 2*cap : 4);
+    new(this->ptr+len) TY(move(x));
+    len++;
+  }
+
+  // removes the items from n on, or default constructs new ones up to n
+  void resize(size_t n) {
+    if (n<len) destroy(this->ptr+n,this->ptr+len);
+    else {
+      reserve(n);
+      uninitialized_default_construct(this->ptr+len,this->ptr+n);
+    }
+    len = n;
+  }
 
   // monadic operations specific to arrays:
 
-  option_ptr<TY[]>& foreach(function<void(TY&)> fun) {
-    for(int i=0;i<len;i++) fun(this->ptr[i]);
+  template<class F>
+  option_ptr& foreach(F&& fun) {
+    TY* a = this->ptr;
+    for(size_t i=0;i<len;i++) fun(a[i]);
     return *this;
   }
-  
-  template<class TU>
-  option_ptr<TU[]> Map(function<TU(TY&)> f) {
-    if (!this->ptr) return Nothing<TU[]>();
-    option_ptr<TU[]> R(len);
-    for(int i=0;i<len;i++) R.ptr[i] = f(this->ptr[i]);
+  // fun is called concurrently on different elements
+  template<class F>
+  option_ptr& foreach(parallel p, F&& fun) {
+    TY* a = this->ptr;
+    run_chunks(parallel_chunks(p,len),len,[&](unsigned, size_t b, size_t e) {
+      for(size_t i=b;i<e;i++) fun(a[i]);
+    });
+    return *this;
+  }
+
+  template<class TU=void, class F>
+  auto Map(F&& f) -> array_of<combinator_result_t<TU,F,TY&>> {
+    using TR = combinator_result_t<TU,F,TY&>;
+    if (!this->ptr) return array_of<TR>();
+    array_of<TR> R = array_of<TR>::with_capacity(len);
+    TY* a = this->ptr;  // locals: the stores to R cannot change them
+    construct_range(R.ptr,0,len,[&](size_t i) -> TR { return f(a[i]); });
+    R.len = len;
+    return R;
+  }//map
+  template<class TU=void, class F>
+  auto Map(parallel p, F&& f) -> array_of<combinator_result_t<TU,F,TY&>> {
+    using TR = combinator_result_t<TU,F,TY&>;
+    if (!this->ptr) return array_of<TR>();
+    array_of<TR> R = array_of<TR>::with_capacity(len);
+    TY* a = this->ptr;
+    TR* r = R.ptr;
+    run_chunks(parallel_chunks(p,len),len,[&](unsigned, size_t b, size_t e) {
+      construct_range(r,b,e,[&](size_t i) -> TR { return f(a[i]); });
+    });
+    R.len = len;
     return R;
   }//map
 
-  // apply left-associative function with default value id
-  TY reduce(function<TY(TY&,TY&)> f, TY id) {
-    if (len==0) return id;
-    TY ax = move(this->ptr[0]);
-    for(int i=1;i<len;i++) ax = f(ax,this->ptr[i]); // no move on R-value
+  // lazy pipeline over the items, e.g. A.lazy().map(f).filter(p).collect()
+  // (see lazy_pipe below)
+  auto lazy() {
+    TY* a = this->ptr;
+    size_t n = len;
+    auto items = [a,n](auto&& sink) {
+      for(size_t i=0;i<n;i++) if (!sink(a[i])) return false;
+      return true;
+    };
+    return lazy_pipe<TY,decltype(items)>(items,n,true);
+  }
+
+  // Left fold: f(...f(f(init,A[0]),A[1])...,A[n-1]), or init if empty.
+  // The accumulator may have another type than the items, which are only
+  // read, never moved, so the array can be folded again.
+  template<class U, class F>
+  U fold(U init, F&& f) {
+    return fold_range(f,move(init),0,len);
+  }
+
+  // apply left-associative function, starting from id; same as fold
+  template<class F>
+  TY reduce(F&& f, TY id) {
+    return fold_range(f,move(id),0,len);
+  }//reduce
+
+  // Prefix scans into a preallocated array out, which may be this array
+  // itself; no memory is allocated.  false (out unchanged) if out is
+  // shorter than this array.
+  // inclusive: out[i] = f(...f(A[0],A[1])...,A[i])
+  template<class F>
+  bool inclusive_scan(option_ptr& out, F&& f) {
+    if (out.len<len) return false;
+    TY* a = this->ptr;
+    TY* r = out.ptr;
+    if (len>0) r[0] = a[0];
+    for(size_t i=1;i<len;i++) r[i] = f(r[i-1],a[i]);
+    return true;
+  }
+  // exclusive: out[0] = init, out[i] = f(out[i-1],A[i-1])
+  template<class F>
+  bool exclusive_scan(option_ptr& out, TY init, F&& f) {
+    if (out.len<len) return false;
+    TY* a = this->ptr;
+    TY* r = out.ptr;
+    for(size_t i=0;i<len;i++) {
+      TY x = a[i];  // read before r[i] is written, in case out is this
+      r[i] = init;
+      init = f(init,x);
+    }
+    return true;
+  }
+
+  // Parallel reduction in order: f must be associative with identity id
+  // (not necessarily commutative).  Each chunk is reduced from id, and the
+  // results of the chunks are combined from left to right.
+  template<class F>
+  TY reduce(parallel p, F&& f, TY id) {
+    unsigned chunks = parallel_chunks(p,len);
+    vector<TY> partial(chunks,id);
+    run_chunks(chunks,len,[&](unsigned c, size_t b, size_t e) {
+      partial[c] = fold_range(f,id,b,e);
+    });
+    TY ax = id;
+    for(TY& x : partial) ax = f(ax,x);
     return ax;
   }//reduce
 
-  template<class TU>
-  option_ptr<TU[]> Map_move(function<TU(TY)> f) {
-    if (!this->ptr) return Nothing<TU[]>();
-    option_ptr<TU[]> R(len);
-    for(int i=0;i<len;i++) R.ptr[i] = f(move(this->ptr[i]));
-    deleter::destruct(this->ptr);
-    len = 0;
+  // Reduction for f associative AND commutative with identity id, e.g. +
+  // on numbers: the items are spread over Lanes independent accumulators,
+  // which the compiler can keep in one SIMD register, and the lanes are
+  // then combined pairwise.  For floating point the result can differ from
+  // a left-to-right reduce in the last bits (usually it is more accurate).
+  template<class F>
+  TY tree_reduce(F&& f, TY id) {
+    return tree_reduce_range(f,id,0,len);
+  }
+  template<class F>
+  TY tree_reduce(parallel p, F&& f, TY id) {
+    unsigned chunks = parallel_chunks(p,len);
+    vector<TY> partial(chunks,id);
+    run_chunks(chunks,len,[&](unsigned c, size_t b, size_t e) {
+      partial[c] = tree_reduce_range(f,id,b,e);
+    });
+    TY ax = id;
+    for(TY& x : partial) ax = f(ax,x);
+    return ax;
+  }
+
+private:
+  static constexpr unsigned Lanes = 8;
+  template<class F>
+  TY tree_reduce_range(F& f, TY id, size_t b, size_t e) {
+    TY lane[Lanes];
+    for(unsigned j=0;j<Lanes;j++) lane[j] = id;
+    TY* a = this->ptr;
+    size_t i = b;
+    for(; i+Lanes<=e; i+=Lanes)
+      for(unsigned j=0;j<Lanes;j++) lane[j] = f(lane[j],a[i+j]);
+    for(unsigned j=0; i<e; i++, j++) lane[j] = f(lane[j],a[i]);
+    for(unsigned w=Lanes/2; w>0; w/=2)
+      for(unsigned j=0;j<w;j++) lane[j] = f(lane[j],lane[j+w]);
+    return lane[0];
+  }
+public:
+
+  template<class TU=void, class F>
+  auto Map_move(F&& f) -> array_of<combinator_result_t<TU,F,TY&&>> {
+    using TR = combinator_result_t<TU,F,TY&&>;
+    if (!this->ptr) return array_of<TR>();
+    array_of<TR> R = array_of<TR>::with_capacity(len);
+    TY* a = this->ptr;
+    construct_range(R.ptr,0,len,[&](size_t i) -> TR { return f(move(a[i])); });
+    R.len = len;
+    release();  // this array is now empty
     return R;
   }//map
 
-  option_ptr<TY[]>& reverse() {
-    for(int i=0;i<len/2;i++) std::swap(this->ptr[i],this->ptr[len-1-i]);
+  // traverse(f), for f returning an option_ptr<U>, is the array of the
+  // values of f(A[0]), f(A[1]), ..., or None (an array without storage)
+  // as soon as one of them is None.  The result is allocated once.
+  template<class F>
+  auto traverse(F&& f)
+    -> array_of<typename option_value<combinator_result_t<void,F,TY&>>::type> {
+    using TR = typename option_value<combinator_result_t<void,F,TY&>>::type;
+    if (!this->ptr) return array_of<TR>();
+    array_of<TR> R = array_of<TR>::with_capacity(len);
+    TY* a = this->ptr;
+    for(size_t i=0;i<len;i++) {
+      auto r = f(a[i]);
+      if (!r.ptr) return array_of<TR>();  // R destroys the items so far
+      new(R.ptr+i) TR(move(*r.ptr));
+      R.len = i+1;
+    }
+    return R;
+  }//traverse
+
+  // For an array of option_ptr<U>: the array of their values, or None if
+  // any is None.  All are checked before the result is allocated.  The
+  // values are copied, or moved out of an rvalue: move(A).sequence().
+  template<class O = TY>
+  auto sequence() & -> array_of<typename option_value<O>::type> {
+    return sequence_from<typename option_value<O>::type,false>();
+  }
+  template<class O = TY>
+  auto sequence() && -> array_of<typename option_value<O>::type> {
+    return sequence_from<typename option_value<O>::type,true>();
+  }
+private:
+  template<class TR, bool moving>
+  array_of<TR> sequence_from() {
+    TY* a = this->ptr;
+    for(size_t i=0;i<len;i++)
+      if (!a[i].ptr) return array_of<TR>();
+    if (!a) return array_of<TR>();
+    array_of<TR> R = array_of<TR>::with_capacity(len);
+    construct_range(R.ptr,0,len,[&](size_t i) -> TR {
+      if constexpr (moving) return move(*a[i].ptr); else return *a[i].ptr;
+    });
+    R.len = len;
+    return R;
+  }
+public:
+
+  option_ptr& reverse() {
+    for(size_t i=0;i<len/2;i++) std::swap(this->ptr[i],this->ptr[len-1-i]);
     return *this;
   }//reverse
 
-  bool swap(unsigned int i, unsigned int k) {
+  ////// sorting: less(x,y) is a strict weak order, < by default
+  template<class Less = std::less<>>
+  option_ptr& sort(Less less = Less()) {
+    std::sort(this->ptr,this->ptr+len,less);
+    return *this;
+  }
+  template<class Less = std::less<>>
+  option_ptr& stable_sort(Less less = Less()) {
+    std::stable_sort(this->ptr,this->ptr+len,less);
+    return *this;
+  }
+  // Parallel merge sort: each chunk is sorted on its own thread, then
+  // neighbouring runs are merged pairwise, halving the runs in each round.
+  template<class Less = std::less<>>
+  option_ptr& sort(parallel p, Less less = Less()) {
+    unsigned chunks = parallel_chunks(p,len);
+    TY* a = this->ptr;
+    size_t n = len;
+    run_chunks(chunks,n,[&](unsigned, size_t b, size_t e) {
+      std::sort(a+b,a+e,less);
+    });
+    for(unsigned w=1; w<chunks; w*=2) {
+      unsigned merges = (chunks+2*w-1)/(2*w);
+      run_chunks(merges,merges,[&](unsigned m, size_t, size_t) {
+        unsigned c = 2*w*m; // runs start where run_chunks split [0,n)
+        size_t b = n*c/chunks;
+        size_t mid = n*min(c+w,chunks)/chunks;
+        size_t e = n*min(c+2*w,chunks)/chunks;
+        std::inplace_merge(a+b,a+mid,a+e,less);
+      });
+    }
+    return *this;
+  }//sort
+
+  // LSD radix sort of numbers, one pass per byte of the key (passes in
+  // which all items share the byte are skipped).  Items end up in the
+  // order of <, except that -0.0 comes before 0.0 and NaNs go to the ends.
+  option_ptr& radix_sort() {
+    static_assert(is_arithmetic<TY>::value && sizeof(TY)<=8,
+                  "radix_sort needs integer or floating point items");
+    if (len<2) return *this;
+    vector<TY> tmp(len);
+    TY* from = this->ptr;
+    TY* to = tmp.data();
+    for(unsigned d=0; d<8*sizeof(TY); d+=8) {
+      size_t count[256] = {0};
+      for(size_t i=0;i<len;i++) count[(radix_key(from[i])>>d) & 255]++;
+      if (count[(radix_key(from[0])>>d) & 255]==len) continue;
+      size_t pos = 0;
+      for(size_t& c : count) { size_t k = c; c = pos; pos += k; }
+      for(size_t i=0;i<len;i++) to[count[(radix_key(from[i])>>d) & 255]++] = from[i];
+      std::swap(from,to);
+    }
+    if (from!=this->ptr) std::copy(from,from+len,this->ptr);
+    return *this;
+  }//radix_sort
+
+  // puts the item that a sort would place at k there, with no greater
+  // item before it and no smaller one after it; false if k is out of range
+  template<class Less = std::less<>>
+  bool nth_element(size_t k, Less less = Less()) {
+    if (k>=len) return false;
+    std::nth_element(this->ptr,this->ptr+k,this->ptr+len,less);
+    return true;
+  }
+
+  // moves the items satisfying pred to the front and returns their count
+  template<class P>
+  size_t partition(P&& pred) {
+    return std::partition(this->ptr,this->ptr+len,pred) - this->ptr;
+  }
+
+private:
+  // unsigned key whose order is the order of the number x
+  static auto radix_key(TY x) {
+    using K = conditional_t<sizeof(TY)==1,uint8_t,
+              conditional_t<sizeof(TY)==2,uint16_t,
+              conditional_t<sizeof(TY)==4,uint32_t,uint64_t>>>;
+    K k;
+    memcpy(&k,&x,sizeof(K));
+    constexpr K top = K(1) << (8*sizeof(K)-1);
+    if constexpr (is_floating_point<TY>::value) return K(k&top ? ~k : k|top);
+    else if constexpr (is_signed<TY>::value) return K(k^top);
+    else return k;
+  }
+public:
+
+  bool swap(size_t i, size_t k) {
     if (i<len && k<len) {
       std::swap(this->ptr[i], this->ptr[k]);
       return true;
@@ -280,7 +1467,7 @@ public:
     else return false;
   }//swap
 
-  bool set(unsigned int i, TY x) {   // checked set
+  bool set(size_t i, TY x) {   // checked set
     if (i<len) {
       this->ptr[i] = move(x);
       return true;
@@ -288,48 +1475,462 @@ public:
     else return false;
   }
 
-  // returns index of first occurrence of x, or .size() if not found
-  unsigned int find(TY& x) {
-    for(unsigned int i=0;i<len;i++)
-      if (x == this->ptr[i]) return i;
+  // returns index of first occurrence of x, or .size() if not found.
+  // For numbers the array is scanned in blocks without early exit inside
+  // a block, which compiles to SIMD compares (e.g. pcmpeq + ptest), and
+  // only the block holding the match is then searched item by item.
+  size_t find(const TY& x) const {
+    const TY* a = this->ptr;
+    size_t i = 0;
+    if constexpr (is_arithmetic<TY>::value) {
+      constexpr size_t Block = 64/sizeof(TY) < 8 ? 8 : 64/sizeof(TY);
+      for(; i+Block<=len; i+=Block) {
+        unsigned any = 0;
+        #pragma GCC unroll 1     // left rolled for the loop vectorizer
+        for(size_t j=0;j<Block;j++) any |= unsigned(a[i+j]==x);
+        if (any) break;
+      }
+    }
+    for(; i<len; i++)
+      if (x == a[i]) return i;
     return len;
   }
 
-  option_ptr<TY[]> join(option_ptr<TY> other) {  // with move
-    unsigned int n = len + other.size();
-    if (n==0) return Nothing<TY[]>();
-    option_ptr<TY[]> J(n);
-    for(auto i=0;i<len;i++) J[i] = move (this->ptr[i]);
-    for(auto i=len;i<n;i++) J[i] = move (other[i-len]);
-    return J;
+  // Bitmap of all occurrences of x: bit i%64 of word i/64 is set iff
+  // A[i]==x (the words are built without branches).
+  option_ptr<uint64_t[]> find_all(const TY& x) const {
+    const TY* a = this->ptr;
+    size_t words = (len+63)/64;
+    option_ptr<uint64_t[]> bits = Some_array_uninit<uint64_t>(words);
+    for(size_t w=0; w<words; w++) {
+      size_t b = 64*w, e = min(b+64,len);
+      uint64_t m = 0;
+      for(size_t i=b;i<e;i++) m |= uint64_t(a[i]==x) << (i-b);
+      bits[w] = m;
+    }
+    return bits;
+  }
+
+  ////// searches of an array sorted by <, in O(log n).  The loop has no
+  // data-dependent branches (each step is a multiply by the comparison),
+  // so it does not suffer branch mispredictions.
+
+  // index of the first item not less than x, or .size() if there is none
+  size_t lower_bound(const TY& x) const {
+    return bound(len,[&x](const TY& y) { return y<x; });
+  }
+  // index of the first item greater than x, or .size() if there is none
+  size_t upper_bound(const TY& x) const {
+    return bound(len,[&x](const TY& y) { return !(x<y); });
+  }
+  // index of an occurrence of x, or .size() if not found
+  size_t find_sorted(const TY& x) const {
+    size_t i = lower_bound(x);
+    return (i<len && !(x<this->ptr[i])) ? i : len;
+  }
+
+  ////// binary serialization, for trivially copyable items: an
+  // array_header, then the bytes of the items.  Read back with
+  // Some_read<TY>, or map without copying with Some_mapped_saved<TY>.
+  bool write(ostream& out) const {
+    static_assert(is_trivially_copyable<TY>::value,
+                  "write requires a trivially copyable type");
+    array_header h;
+    h.item_size = sizeof(TY);
+    h.count = len;
+    out.write(reinterpret_cast<const char*>(&h),sizeof(h));
+    if (len) out.write(reinterpret_cast<const char*>(this->ptr),len*sizeof(TY));
+    return bool(out);
+  }
+  bool save(const string& path) const {
+    ofstream out(path,ios::binary);
+    return write(out) && out.flush();
+  }
+
+private:
+  // number of leading items for which before(item) holds
+  template<class P>
+  size_t bound(size_t n, P before) const {
+    if (n==0) return 0;
+    const TY* a = this->ptr;
+    size_t lo = 0;
+    while (n>1) {
+      size_t half = n/2;
+      lo += half*before(a[lo+half-1]);  // a step, not a branch
+      n -= half;
+    }
+    return lo + before(a[lo]);
+  }
+public:
+
+  // Appends the items of other (moved) to this array in place, growing
+  // its storage geometrically, so that repeated joins take amortized time
+  // proportional to the items joined.  Returns the joined array; this one
+  // and other are left empty.  J = move(A).join(move(B)) in effect.
+  option_ptr join(option_ptr other) {  // with move
+    if (len+other.len > cap) reserve(max(len+other.len,2*cap));
+    uninitialized_move_n(other.ptr,other.len,this->ptr+len);
+    len += other.len;
+    other.release();
+    return move(*this);
   }
   
   // move semantics must be redefined because of type (and len)
-  option_ptr<TY[]>& operator=(option_ptr<TY[]>&& other) { 
-    if (this->ptr) deleter::destruct(this->ptr);
+  option_ptr& operator=(option_ptr&& other) { 
+    if (this == &other) return *this;
+    release();
     this->ptr = other.ptr;
     len = other.len;
+    cap = other.cap;
     other.ptr = nullptr;
-    other.len = 0;
+    other.len = other.cap = 0;
     return *this;
   }// move assignment operator
 
-  option_ptr(option_ptr<TY[]>&& other) {
-    if (this->ptr) deleter::destruct(this->ptr);
+  option_ptr(option_ptr&& other) {
     this->ptr = other.ptr;
     len = other.len;    
+    cap = other.cap;
     other.ptr = nullptr;    
-    other.len = 0;    
+    other.len = other.cap = 0;    
   }// move constructor
 
 };//option_ptr<TY[]>
 
 
-template<class TY>
-option_ptr<TY[]> Some_array(unsigned int n) {
-  return option_ptr<TY[]>(n);
+// Some_array<T>(n), or Some_array<T,storage>(n) with another storage
+// policy, e.g. Some_array<float,aligned_deleter<float[],64>>(n)
+template<class TY, class deleter>
+option_ptr<TY[],deleter> Some_array(size_t n) {
+  return option_ptr<TY[],deleter>(n);
+}
+
+// sequence(A) for an array of option_ptrs, as A.sequence()
+template<class TY, class D, class deleter>
+auto sequence(option_ptr<option_ptr<TY,D>[],deleter>& A) {
+  return A.sequence();
+}
+template<class TY, class D, class deleter>
+auto sequence(option_ptr<option_ptr<TY,D>[],deleter>&& A) {
+  return move(A).sequence();
+}
+
+// n items left uninitialized, to be written before they are read; for
+// trivially constructible types only, e.g. numbers
+template<class TY, class deleter>
+option_ptr<TY[],deleter> Some_array_uninit(size_t n) {
+  static_assert(is_trivially_default_constructible<TY>::value &&
+                is_trivially_destructible<TY>::value,
+                "Some_array_uninit requires a trivial type");
+  option_ptr<TY[],deleter> R = option_ptr<TY[],deleter>::with_capacity(n);
+  R.len = n;
+  return R;
+}
+
+// Reads an array saved by write/save; Nothing if the stream does not hold
+// an array of TY or ends early.  The items are read in chunks of about
+// 1MB and the storage grows as they arrive, so that a corrupt count fails
+// at the end of the stream instead of allocating it all up front.
+template<class TY, class deleter>
+option_ptr<TY[],deleter> Some_read(istream& in) {
+  static_assert(is_trivially_copyable<TY>::value,
+                "Some_read requires a trivially copyable type");
+  using array = option_ptr<TY[],deleter>;
+  array_header h;
+  if (!in.read(reinterpret_cast<char*>(&h),sizeof(h)) ||
+      !h.valid(sizeof(TY)) || h.count > SIZE_MAX/sizeof(TY))
+    return array();
+  const size_t count = h.count, chunk = max<size_t>(1,(1<<20)/sizeof(TY));
+  array R = array::with_capacity(min(count,chunk));
+  size_t got = 0;  // items read so far
+  while (got<count) {
+    size_t n = min(count-got,chunk);
+    if (got+n > R.cap) {  // grow geometrically, up to count
+      array S = array::with_capacity(max(got+n,min(count,2*R.cap)));
+      memcpy(S.ptr,R.ptr,got*sizeof(TY));
+      R = move(S);
+    }
+    if (!in.read(reinterpret_cast<char*>(R.ptr+got),n*sizeof(TY)))
+      return array();
+    got += n;
+  }
+  R.len = count;
+  return R;
+}
+template<class TY, class deleter = pointer_deleter<TY[]>>
+option_ptr<TY[],deleter> Some_read(const string& path) {
+  ifstream in(path,ios::binary);
+  return Some_read<TY,deleter>(in);
 }
 
+#ifdef OPTION_PTR_MMAP
+// Maps the file at path into memory as an array of size/sizeof(TY) items,
+// without reading or copying it: pages are loaded on first access, and
+// shared with the page cache.  Nothing if the file cannot be opened or
+// mapped, or holds no complete item.
+template<class TY>
+option_ptr<TY[],mapped_deleter<TY[]>> Some_mapped(const string& path, map_mode mode) {
+  static_assert(is_trivially_copyable<TY>::value,
+                "Some_mapped requires a trivially copyable type");
+  option_ptr<TY[],mapped_deleter<TY[]>> R;
+  size_t size;
+  int fd = open_mappable(path,mode,size);
+  if (fd<0) return R;
+  size_t n = size/sizeof(TY);
+  if (n>0)
+    if (void* p = map_open(fd,n*sizeof(TY),mode)) {
+      option_ptr_events::allocated(p,n*sizeof(TY));  // freed by the munmap
+      R.ptr = static_cast<TY*>(p);
+      R.len = R.cap = n;
+    }
+  close(fd);  // the mapping stays valid
+  return R;
+}//Some_mapped
+
+// Maps an array saved by write/save, without reading or copying it, so
+// that even a large array is ready at once.  Nothing if the file is not
+// such an array of TY (or is too short for its header's count).
+template<class TY>
+option_ptr<TY[],mapped_deleter<TY[]>> Some_mapped_saved(const string& path, map_mode mode) {
+  static_assert(is_trivially_copyable<TY>::value &&
+                alignof(TY)<=sizeof(array_header),
+                "Some_mapped_saved requires a trivially copyable type");
+  option_ptr<TY[],mapped_deleter<TY[]>> R;
+  size_t size;
+  int fd = open_mappable(path,mode,size);
+  if (fd<0) return R;
+  array_header h;
+  if (pread(fd,&h,sizeof(h),0)==(ssize_t)sizeof(h) && h.valid(sizeof(TY)) &&
+      h.count <= (size-sizeof(h))/sizeof(TY))
+    if (void* p = map_open(fd,sizeof(h)+h.count*sizeof(TY),mode)) {
+      TY* items = reinterpret_cast<TY*>(static_cast<char*>(p)+sizeof(h));
+      option_ptr_events::allocated(items,h.count*sizeof(TY));
+      R.ptr = items;
+      R.len = R.cap = h.count;
+    }
+  close(fd);
+  return R;
+}//Some_mapped_saved
+
+template<class TY>
+using mapped_array = option_ptr<TY[],mapped_deleter<TY[]>>;
+#endif
+
+// arrays for SIMD kernels (AVX-512 loads are 64 bytes) and for large
+// buffers backed by huge pages
+template<class TY, size_t Align = 64>
+using aligned_array = option_ptr<TY[],aligned_deleter<TY[],Align>>;
+template<class TY>
+using huge_page_array = option_ptr<TY[],huge_page_deleter<TY[]>>;
+
+
+////////////////////////////////////////////////////////////////////////////
+///////////////// Lazy pipelines over arrays
+/*
+ A.lazy() starts a pipeline over the items of the array A.  The stages
+ map(f), filter(p) and take(n) are only recorded; a terminal operation,
+ fold, reduce, foreach, count or collect, then runs all of them in a
+ single pass over A with no intermediate arrays: each item goes through
+ the whole pipeline before the next one is read, and take stops the pass
+ early.  A pipeline refers to the items of A, so it must not outlive A.
+*/
+
+template<class T, class Gen>
+class lazy_pipe {
+private:
+  Gen gen;       // gen(sink) calls sink on each item until sink returns false
+  size_t bound;  // number of items, at most
+  bool exact;    // exactly bound items (no filter on the way)
+public:
+  using value_type = T;
+  lazy_pipe(Gen g, size_t b, bool e): gen{move(g)}, bound{b}, exact{e} {}
+
+  template<class F>
+  auto map(F f) const {
+    using TR = decay_t<invoke_result_t<const F&,T&>>;
+    auto g = [src=gen,f](auto&& sink) {
+      return src([&](auto&& x) { return sink(f(x)); });
+    };
+    return lazy_pipe<TR,decltype(g)>(g,bound,exact);
+  }
+
+  template<class P>
+  auto filter(P p) const {
+    auto g = [src=gen,p](auto&& sink) {
+      return src([&](auto&& x) { return p(x) ? sink(x) : true; });
+    };
+    return lazy_pipe<T,decltype(g)>(g,bound,false);
+  }
+
+  // only the first n items
+  auto take(size_t n) const {
+    auto g = [src=gen,n](auto&& sink) {
+      size_t left = n;
+      if (left==0) return false;
+      return src([&](auto&& x) { return sink(x) && --left>0; });
+    };
+    return lazy_pipe<T,decltype(g)>(g,min(n,bound),exact);
+  }
+
+  ////// terminal operations
+
+  template<class U, class F>
+  U fold(U init, F f) const {
+    gen([&](auto&& x) { init = f(init,x); return true; });
+    return init;
+  }
+  template<class F>
+  T reduce(F f, T id) const { return fold(move(id),f); }
+
+  template<class F>
+  void foreach(F f) const {
+    gen([&](auto&& x) { f(x); return true; });
+  }
+
+  size_t count() const {
+    size_t c = 0;
+    gen([&](auto&&) { c++; return true; });
+    return c;
+  }
+
+  // materializes the pipeline into a new array
+  option_ptr<T[]> collect() const {
+    option_ptr<T[]> R;
+    if (exact) R.reserve(bound);
+    gen([&](auto&& x) { R.push_back(std::forward<decltype(x)>(x)); return true; });
+    return R;
+  }
+}; // lazy_pipe class
+
+
+
+////////////////////////////////////////////////////////////////////////////
+///////////////// Handing option_ptrs between threads
+/*
+ atomic_option_ptr<T> is a slot that threads move option_ptr<T> values in
+ and out of atomically, with no lock: the value is owned by exactly one of
+ the slot or the thread that took it.  channel<T> is a bounded lock-free
+ queue of option_ptr<T> for any number of producers and consumers (each
+ cell carries a sequence number telling its turn; D. Vyukov's design).
+ Only the pointer moves, so items of any size cost the same.  Both release
+ values with acquire/release ordering: what the sender wrote into the value
+ is visible to the receiver.
+*/
+
+template<class TY>
+class atomic_option_ptr {
+private:
+  atomic<TY*> ptr;
+public:
+  atomic_option_ptr(): ptr{nullptr} {}  // None
+  atomic_option_ptr(option_ptr<TY>&& p): ptr{option_access::release(p)} {}
+  ~atomic_option_ptr() { option_access::adopt(ptr.load()); }  // drops it
+  static constexpr bool is_always_lock_free = atomic<TY*>::is_always_lock_free;
+
+  // puts p in, returns the previous value
+  option_ptr<TY> exchange(option_ptr<TY>&& p) {
+    TY* q = ptr.exchange(option_access::release(p),memory_order_acq_rel);
+    return option_access::adopt(q);
+  }
+  // takes the value out, leaving None
+  option_ptr<TY> take() {
+    return option_access::adopt(ptr.exchange(nullptr,memory_order_acq_rel));
+  }
+  void store(option_ptr<TY>&& p) { exchange(move(p)); }  // drops the old one
+
+  // Moves desired in if the slot holds None, and returns true; otherwise
+  // returns false and desired keeps its value.  (None is the only value a
+  // thread can expect, since the value in the slot is never shared.)
+  bool compare_and_set(option_ptr<TY>& desired) {
+    TY* expected = nullptr;
+    if (!ptr.compare_exchange_strong(expected,option_access::get(desired),
+                                     memory_order_acq_rel,memory_order_relaxed))
+      return false;
+    option_access::release(desired);
+    return true;
+  }
+
+  bool is_none() const { return ptr.load(memory_order_acquire)==nullptr; }
+}; // atomic_option_ptr class
+
+template<class TY>
+class channel {
+private:
+  struct cell {
+    atomic<size_t> seq;  // pos: free for send pos, pos+1: full for receive pos
+    TY* item;
+  };
+  option_ptr<cell[]> cells;
+  size_t mask;
+  // the next positions to send and receive, on separate cache lines so
+  // that producers and consumers do not slow each other down
+  alignas(64) atomic<size_t> tail{0};
+  alignas(64) atomic<size_t> head{0};
+
+public:
+  // room for at least n items (rounded up to a power of two)
+  explicit channel(size_t n) {
+    size_t c = 1;
+    while (c<n) c *= 2;
+    cells = Some_array<cell>(c);
+    for(size_t i=0;i<c;i++) cells[i].seq.store(i,memory_order_relaxed);
+    mask = c-1;
+  }
+  ~channel() { while (try_receive()) {} }  // drops the items left
+  size_t capacity() const { return mask+1; }
+
+  // Moves x into the channel and returns true, or returns false, leaving x
+  // unchanged, if the channel is full or x is None.
+  bool try_send(option_ptr<TY>& x) {
+    if (!option_access::get(x)) return false;
+    size_t pos = tail.load(memory_order_relaxed);
+    cell* c;
+    for(;;) {
+      c = &cells[pos & mask];
+      size_t seq = c->seq.load(memory_order_acquire);
+      if (seq==pos) {
+        if (tail.compare_exchange_weak(pos,pos+1,memory_order_relaxed)) break;
+      }
+      else if (seq<pos) return false;  // the cell is a lap behind: full
+      else pos = tail.load(memory_order_relaxed);
+    }
+    c->item = option_access::release(x);
+    c->seq.store(pos+1,memory_order_release);
+    return true;
+  }//try_send
+
+  // the oldest item, or None if the channel is empty
+  option_ptr<TY> try_receive() {
+    size_t pos = head.load(memory_order_relaxed);
+    cell* c;
+    for(;;) {
+      c = &cells[pos & mask];
+      size_t seq = c->seq.load(memory_order_acquire);
+      if (seq==pos+1) {
+        if (head.compare_exchange_weak(pos,pos+1,memory_order_relaxed)) break;
+      }
+      else if (seq<pos+1) return option_ptr<TY>();  // empty
+      else pos = head.load(memory_order_relaxed);
+    }
+    TY* p = c->item;
+    c->seq.store(pos+mask+1,memory_order_release);  // free for the next lap
+    return option_access::adopt(p);
+  }//try_receive
+
+  // blocking versions, which yield while the channel is full or empty
+  void send(option_ptr<TY>&& x) {
+    if (!option_access::get(x)) return;
+    while (!try_send(x)) this_thread::yield();
+  }
+  option_ptr<TY> receive() {
+    for(;;) {
+      option_ptr<TY> x = try_receive();
+      if (x) return x;
+      this_thread::yield();
+    }
+  }
+}; // channel class
+
 
 /* DEMO
 
@@ -340,9 +1941,11 @@ void arraydemo() {
 
   for(int i=0;i<10;i++) A[i] = i*i;
   for(int i=0;i<A.size();i++) cout << A[i] << ", ";  cout << endl;
-  A.map_do([](int& x){cout << "I did it\n";});
-  A(3).map_do([](int& x) { cout << "got " << x << endl; }); // inherited
+  A(0).map_do([](int& x){cout << "I did it\n";});
+  A(3).map_do([](int& x) { cout << "got " << x << endl; }); // no copy
   A(13).map_do([](int& x) { cout << "got " << x << endl; });
+  A(3).mutate([](int& x) { return x+1; });  // changes A[3]
+  cout << "A[3] is now " << A[3] << ", A(3) is " << A(3) << endl;
   option_ptr<int[]> B = move(A);
   A(4).map_do([](int& x) { cout << "A got " << x << endl; });
   B(4).map_do([](int& x) { cout << "B got " << x << endl; });
@@ -355,10 +1958,35 @@ void arraydemo() {
     .reduce([](int& x, int& y) {return x-y;}, 0);
     
   cout << "sum: " << sum << endl;
+  auto firstodd =  // one pass, no temporary arrays
+    B2.lazy()
+    .map([](int& x) {return x/10;})
+    .filter([](int x) {return x%2==1;})
+    .take(3)
+    .collect();
+  cout << "first odd squares:";
+  firstodd.foreach([](int& x) { cout << " " << x; });
+  cout << endl;
+  cout << "sum again: " << B2.fold(0,[](int x, int& y) {return x+y;}) << endl;
+  B2.inclusive_scan(B2,[](int x, int y) {return x+y;});  // in place
+  cout << "prefix sums:";
+  B2.foreach([](int& x) { cout << " " << x; });
+  cout << endl;
+  cout << "2300 at " << B2.find_sorted(2300) << ", first above 2000 at "
+       << B2.upper_bound(2000) << ", 2860 at bits "
+       << B2.find_all(2860)[0] << endl;  // bitmap of indices 8 and 9
+  B2.sort(greater<int>());
+  cout << "descending:";
+  B2.foreach([](int& x) { cout << " " << x; });
+  cout << endl;
 
   option_ptr<option_ptr<int>[]> D = Some_array<option_ptr<int>>(2);
   D[1] = Some<int>(55);
-  //D(1).map_do([](auto& x){});  // won't compile: requires std::copyable
+  D(1).map_do([](auto& x){ cout << "D(1) holds " << x << endl; }); // not copied
+  cout << "sequence(D) has storage: " << bool(sequence(D)) << endl; // D[0] None
+  D[0] = Some<int>(44);
+  cout << "sequence(D) sums to "
+       << sequence(D).reduce([](int x, int y) {return x+y;}, 0) << endl;
   cout << "\nend of arraydemo\n";
 }
 
@@ -429,7 +2057,33 @@ int main(int argc, char* argv[]) {
   
   num2.memcpy_from(num2,sizeof(int));
   cout << "num2: " << num2 << endl;
-  
+  // one check of both operands, instead of nested binds
+  cout << "number/num2: "
+       << bind_n([](int& x, int& y) { return safediv(x,y); }, number, num2)
+       << endl;
+  zip(number,num2).map_do([](auto& xy) {
+    cout << "zipped: " << get<0>(xy) << " and " << get<1>(xy) << endl;
+  });
+
+  // map_move reuses the heap slot, also when f hands back its argument
+  auto word = Some<string>("option");
+  word = word.map_move([](string&& w) -> string&& {
+    w += "_ptr";
+    return move(w);
+  });
+  cout << "moved word: " << word << endl;
+
+  // ownership of each job passes to the receiving thread, without a lock
+  channel<string> jobs(2);
+  thread producer([&jobs]() {
+    for(int i=1;i<=3;i++) jobs.send(Some<string>("job " + to_string(i)));
+  });
+  for(int i=0;i<3;i++) cout << "received " << jobs.receive() << endl;
+  producer.join();
+
+#ifdef OPTION_PTR_STATS
+  cout << option_ptr_stats() << endl;
+#endif
   return 0;
 }//main
 */